@@ -0,0 +1,277 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h> // GetProcessMemoryInfo
+#else
+#include <sys/resource.h> // getrusage
+#endif
+
+#include "filters.h"
+#include "image.h"
+
+#include "haze_removal.h"
+#include "synthetic_haze.h"
+#include "thread_pool.h"
+#include "verify.h"
+
+using namespace ImgProc;
+
+namespace {
+
+struct Options {
+	std::vector<double> megapixels{ 1.0, 4.0, 16.0 };
+	std::vector<size_t> radii{ 9 };
+	size_t warmup = 1;
+	size_t repetitions = 5;
+	size_t threads = 0; // One per hardware thread
+	float beta = 1.0f;
+	size_t subsample = 1; // Guided filter subsampling ratio
+	uint32_t seed = 1;
+	std::string input; // Generate test images if empty
+	bool verify = false; // Check filters against reference implementations instead
+};
+
+// Silences logging to std::cout (e.g. from image loading) while in scope.
+class SilenceStdout {
+public:
+	SilenceStdout() : m_buf(std::cout.rdbuf(nullptr)) {}
+	~SilenceStdout() { std::cout.rdbuf(m_buf); }
+
+private:
+	std::streambuf* m_buf;
+};
+
+// Run-times of one pipeline stage over all repetitions.
+struct Stage {
+	std::string name;
+	std::vector<double> milliseconds;
+};
+
+template <typename Fn>
+double timeMilliseconds(Fn fn) {
+	const auto start = std::chrono::steady_clock::now();
+	fn();
+	const auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Value below which fraction p of the samples fall.
+double percentile(std::vector<double> samples, double p) {
+	std::sort(samples.begin(), samples.end());
+	const auto rank = size_t(std::ceil(p * double(samples.size())));
+	return samples[std::min(samples.size() - 1, std::max(rank, size_t(1)) - 1)];
+}
+
+// Peak resident memory of the process so far in MiB, or 0 if unknown.
+double peakMemoryMiB() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) { return 0.0; }
+	return double(counters.PeakWorkingSetSize) / (1024.0 * 1024.0);
+#else
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) { return 0.0; }
+#ifdef __APPLE__
+	return double(usage.ru_maxrss) / (1024.0 * 1024.0); // In bytes
+#else
+	return double(usage.ru_maxrss) / 1024.0; // In KiB
+#endif
+#endif
+}
+
+void report(const std::vector<Stage>& stages, double megapixels) {
+	std::cout << std::left << std::setw(16) << "stage" << std::right
+		<< std::setw(12) << "median ms" << std::setw(12) << "p95 ms" << std::setw(12) << "MPix/s\n";
+
+	for (const auto& stage : stages) {
+		const double median = percentile(stage.milliseconds, 0.5);
+
+		std::cout << std::left << std::setw(16) << stage.name << std::right << std::fixed
+			<< std::setprecision(2) << std::setw(12) << median
+			<< std::setw(12) << percentile(stage.milliseconds, 0.95)
+			<< std::setw(12) << megapixels / (median / 1000.0) << "\n";
+	}
+
+	std::cout << std::endl;
+}
+
+// Time each stage of the dehaze pipeline on inputFile with the given radius.
+void benchmark(const std::string& inputFile, size_t r, const Options& options) {
+	const std::string outputFile = "dehaze_bench_output.jpg";
+
+	std::vector<Stage> stages{
+		{ "load", {} }, { "depth", {} }, { "guidedFilter", {} }, { "removeHaze", {} }, { "save", {} }
+	};
+
+	coord_int width = 0, height = 0;
+
+	for (size_t i = 0; i < options.warmup + options.repetitions; ++i) {
+		SilenceStdout silence;
+
+		ImageRgb hazyImg{ 0, 0 };
+		ImageGrey depth{ 0, 0 }, depthFiltered{ 0, 0 };
+		ImageRgb J{ 0, 0 };
+
+		const double times[] = {
+			timeMilliseconds([&] { hazyImg = loadRgbImage(inputFile); }),
+			timeMilliseconds([&] { depth = filters::getDepthFromHazyImage(hazyImg, r); }),
+			timeMilliseconds([&] {
+				depthFiltered = filters::guidedFilter(
+					depth, hazyImg, r, 0.00001f, options.subsample
+				);
+			}),
+			timeMilliseconds([&] { J = filters::removeHaze(hazyImg, depthFiltered, options.beta); }),
+			timeMilliseconds([&] { saveRgbImage(J, outputFile); })
+		};
+
+		width = hazyImg.width();
+		height = hazyImg.height();
+
+		if (i < options.warmup) { continue; }
+
+		for (size_t s = 0; s < stages.size(); ++s) { stages[s].milliseconds.push_back(times[s]); }
+	}
+
+	std::remove(outputFile.c_str());
+
+	const double megapixels = double(width) * double(height) / 1.0e6;
+
+	std::cout << "Image " << width << 'x' << height << " (" << std::fixed << std::setprecision(1)
+		<< megapixels << " MP), radius " << r << ", subsample " << options.subsample << ", "
+		<< options.repetitions << " repetitions, " << getThreadCount() << " threads, peak memory "
+		<< std::setprecision(0) << peakMemoryMiB() << " MiB" << std::endl;
+
+	report(stages, megapixels);
+}
+
+// Size of generated images of the given number of megapixels, with a 3:2 aspect ratio.
+Coord imageSize(double megapixels) {
+	const auto width = coord_int(std::lround(std::sqrt(megapixels * 1.0e6 * 1.5)));
+	return Coord{ width, coord_int(std::lround(double(width) / 1.5)) };
+}
+
+// Comma-separated list of values, of which there must be at least one.
+template <typename T>
+std::vector<T> parseList(const std::string& str) {
+	std::vector<T> values;
+	std::istringstream ss{ str };
+	std::string item;
+
+	auto invalid = [&] {
+		std::cerr << "Invalid argument '" << str << "'." << std::endl;
+		std::terminate();
+	};
+
+	while (std::getline(ss, item, ',')) {
+		std::istringstream itemStream{ item };
+		T value;
+		itemStream >> value;
+
+		if (itemStream.fail()) { invalid(); }
+
+		values.push_back(value);
+	}
+
+	if (values.empty()) { invalid(); }
+
+	return values;
+}
+
+} // namespace
+
+int main(int argn, char* argv[]) {
+	Options options;
+
+	auto handleArg = [](const std::string& str, auto& out) {
+		auto tmp = out;
+		std::istringstream ss{ str };
+		ss >> tmp;
+
+		if (ss.fail()) {
+			std::cerr << "Invalid argument '" << str << "'." << std::endl;
+			std::terminate();
+		}
+
+		out = tmp;
+	};
+
+	for (int i = 1; i < argn; ++i) {
+		const std::string arg{ argv[i] };
+
+		if (arg == "--verify") {
+			options.verify = true;
+			continue;
+		}
+
+		if (arg == "-h" || arg == "--help" || i + 1 == argn) {
+			std::cout << "Usage: dehaze_bench [-i file] [-s megapixels,...] [-r radius,...]"
+				" [-w warmup] [-n repetitions] [-t threads] [-b beta] [-f subsample] [-g seed]"
+				" [--verify]\n"
+				"Times each stage of the dehaze pipeline. Without -i, generates synthetic hazy images"
+				" of the given sizes (default 1,4,16 MP) from the given seed.\n"
+				"With --verify, checks the filters against reference implementations on random images"
+				" from the given seed instead, then reports their throughput at the first size and"
+				" radius given. Exits with status 1 if any filter is out of tolerance." << std::endl;
+			return arg == "-h" || arg == "--help" ? 0 : 1;
+		}
+
+		const std::string value{ argv[++i] };
+
+		if (arg == "-i")      { options.input = value; }
+		else if (arg == "-s") { options.megapixels = parseList<double>(value); }
+		else if (arg == "-r") { options.radii = parseList<size_t>(value); }
+		else if (arg == "-w") { handleArg(value, options.warmup); }
+		else if (arg == "-n") { handleArg(value, options.repetitions); }
+		else if (arg == "-t") { handleArg(value, options.threads); }
+		else if (arg == "-b") { handleArg(value, options.beta); }
+		else if (arg == "-f") { handleArg(value, options.subsample); }
+		else if (arg == "-g") { handleArg(value, options.seed); }
+		else {
+			std::cerr << "Unknown option '" << arg << "'." << std::endl;
+			return 1;
+		}
+	}
+
+	options.repetitions = std::max(options.repetitions, size_t(1));
+	setThreadCount(options.threads);
+
+	if (options.verify) {
+		const auto size = imageSize(options.megapixels.front());
+		const bool passed = verifyFilters(
+			options.seed, size.x, size.y, options.radii.front(), options.repetitions
+		);
+
+		return passed ? 0 : 1;
+	}
+
+	if (!options.input.empty()) {
+		for (auto r : options.radii) { benchmark(options.input, r, options); }
+		return 0;
+	}
+
+	// Generated images are saved first, so that loading is timed too.
+	const std::string inputFile = "dehaze_bench_input.jpg";
+
+	for (auto megapixels : options.megapixels) {
+		const auto size = imageSize(megapixels);
+
+		{
+			SilenceStdout silence;
+			saveRgbImage(generateHazyScene(size.x, size.y, options.seed, options.beta).hazy, inputFile);
+		}
+
+		for (auto r : options.radii) { benchmark(inputFile, r, options); }
+	}
+
+	std::remove(inputFile.c_str());
+}
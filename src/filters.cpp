@@ -46,92 +46,567 @@
 
 namespace ImgProc { namespace filters {
 
-// Set of intermediate results of guided filter that can be reused for filtering different images
-// with the same guide image.
-class GuidedFilterValues {
-public:
-	GuidedFilterValues(const ImageRgb& guide, size_t r, float eps)
-		: radius(r * 2 + 1)
-		, I(splitChannels(guide))
-		, mean_I_r(boxFilter(I[0], radius))
-		, mean_I_g(boxFilter(I[1], radius))
-		, mean_I_b(boxFilter(I[2], radius))
-
-		, var_I_rr((boxFilter(I[0] * I[0], radius) - mean_I_r * mean_I_r) + eps)
-		, var_I_rg( boxFilter(I[0] * I[1], radius) - mean_I_r * mean_I_g)
-		, var_I_rb( boxFilter(I[0] * I[2], radius) - mean_I_r * mean_I_b)
-		, var_I_gg((boxFilter(I[1] * I[1], radius) - mean_I_g * mean_I_g) + eps)
-		, var_I_gb( boxFilter(I[1] * I[2], radius) - mean_I_g * mean_I_b)
-		, var_I_bb((boxFilter(I[2] * I[2], radius) - mean_I_b * mean_I_b) + eps)
-
-		, invrr(var_I_gg * var_I_bb - var_I_gb * var_I_gb)
-		, invrg(var_I_gb * var_I_rb - var_I_rg * var_I_bb)
-		, invrb(var_I_rg * var_I_gb - var_I_gg * var_I_rb)
-		, invgg(var_I_rr * var_I_bb - var_I_rb * var_I_rb)
-		, invgb(var_I_rb * var_I_rg - var_I_rr * var_I_gb)
-		, invbb(var_I_rr * var_I_gg - var_I_rg * var_I_rg)
-	{
-		const auto covDet = invrr * var_I_rr + invrg * var_I_rg + invrb * var_I_rb;
-
-		invrr /= covDet;
-		invrg /= covDet;
-		invrb /= covDet;
-		invgg /= covDet;
-		invgb /= covDet;
-		invbb /= covDet;
+RowSource rowsOf(const ImageGrey& image) {
+	return [&image](coord_int y, float*) { return &image.getPixelUnsafe(Coord{ 0, y }); };
+}
+
+PixelRowSource rowsOf(const ImageRgb& image) {
+	return [&image](coord_int y, Pixel*) { return &image.getPixelUnsafe(Coord{ 0, y }); };
+}
+
+RowSource rowsOfProduct(const ImageGrey& a, const ImageGrey& b) {
+	assert(a.width() == b.width() && a.height() == b.height());
+
+	return [&a, &b](coord_int y, float* buffer) {
+		const float* rowA = &a.getPixelUnsafe(Coord{ 0, y });
+		const float* rowB = &b.getPixelUnsafe(Coord{ 0, y });
+
+		for (coord_int x = 0; x < a.width(); ++x) { buffer[x] = rowA[x] * rowB[x]; }
+
+		return static_cast<const float*>(buffer);
+	};
+}
+
+std::vector<ImageGrey> boxFilterMany(
+	coord_int width, coord_int height, const std::vector<RowSource>& planes, size_t windowSize
+) {
+	std::vector<ImageGrey> out;
+	BoxFilterBuffers<float> buffers;
+
+	boxFilterMany(width, height, planes, windowSize, out, buffers);
+
+	return out;
+}
+
+// Resize out to hold count images of width x height, reusing the images already there that have
+// that size.
+static void resizePlanes(
+	coord_int width, coord_int height, size_t count, std::vector<ImageGrey>& out
+) {
+	if (out.size() > count) { out.erase(out.begin() + ptrdiff_t(count), out.end()); }
+
+	for (auto& image : out) {
+		if (image.width() != width || image.height() != height) { image = ImageGrey{ width, height }; }
 	}
 
-	size_t radius;
-	std::array<ImageGrey, 3> I;
-	ImageGrey mean_I_r, mean_I_g, mean_I_b;
-	ImageGrey var_I_rr, var_I_rg, var_I_rb, var_I_gg, var_I_gb, var_I_bb;
-	ImageGrey invrr, invrg, invrb, invgg, invgb, invbb;
-};
+	while (out.size() < count) { out.emplace_back(width, height); }
+}
+
+void boxFilterMany(
+	coord_int width, coord_int height, const std::vector<RowSource>& planes, size_t windowSize,
+	std::vector<ImageGrey>& out, BoxFilterBuffers<float>& buffers
+) {
+	resizePlanes(width, height, planes.size(), out);
+
+	boxFilterPlanes(
+		std::max(coord_int(1), coord_int(windowSize)),
+		[&](size_t plane, coord_int y, float* buffer) { return planes[plane](y, buffer); },
+		out, buffers
+	);
+}
+
+// Call fn(i) for the index i of each pixel of a width x height image, rows in parallel on the
+// shared thread pool. Per-pixel arithmetic on several planes is done in one such pass, rather than
+// through image operators, each of which would allocate an image and walk memory of its own.
+template <typename Fn>
+static void forEachPixelParallel(coord_int width, coord_int height, Fn fn) {
+	const auto row = [&](size_t y) {
+		const auto begin = y * size_t(width);
+		for (auto i = begin; i < begin + size_t(width); ++i) { fn(i); }
+	};
+
+	getThreadPool().parallelFor(size_t(height), std::cref(row));
+}
+
+// Rows of channel c of image.
+static RowSource rowsOfChannel(const ImageRgb& image, size_t c) {
+	return [&image, c](coord_int y, float* buffer) {
+		const Pixel* row = &image.getPixelUnsafe(Coord{ 0, y });
+
+		for (coord_int x = 0; x < image.width(); ++x) { buffer[x] = row[x].values[c]; }
+
+		return static_cast<const float*>(buffer);
+	};
+}
+
+// Rows of the product of channels c and d of image.
+static RowSource rowsOfChannelProduct(const ImageRgb& image, size_t c, size_t d) {
+	return [&image, c, d](coord_int y, float* buffer) {
+		const Pixel* row = &image.getPixelUnsafe(Coord{ 0, y });
+
+		for (coord_int x = 0; x < image.width(); ++x) {
+			buffer[x] = row[x].values[c] * row[x].values[d];
+		}
+
+		return static_cast<const float*>(buffer);
+	};
+}
+
+// Channel c of a pixel, greyscale pixels having the one channel 0.
+static float& channel(float& pixel, size_t) { return pixel; }
+static const float& channel(const float& pixel, size_t) { return pixel; }
+static float& channel(Pixel& pixel, size_t c) { return pixel.values[c]; }
+static const float& channel(const Pixel& pixel, size_t c) { return pixel.values[c]; }
+
+//--------------------------------------------------------------------------------------------------
+// Fast guided filter (He and Sun 2015): coefficients are computed on subsampled input and guide,
+// then upsampled and applied to the full resolution guide.
+//--------------------------------------------------------------------------------------------------
+
+// Mean of each block of subsample x subsample pixels of image into out, which is resized unless it
+// already has the size of the blocks, blocks at the right and bottom borders being cut short.
+template <typename PixelT>
+static void downsample(const BaseImage<PixelT>& image, coord_int subsample, BaseImage<PixelT>& out) {
+	const auto width = coord_int(numBlocks(image.width(), subsample));
+	const auto height = coord_int(numBlocks(image.height(), subsample));
+
+	if (out.width() != width || out.height() != height) { out = BaseImage<PixelT>{ width, height }; }
+
+	if (out.data().empty()) { return; }
+
+	const auto downsampleRow = [&](size_t row) {
+		const auto rows = blockRange(row, subsample, image.height());
+		PixelT* rowOut = &out.getPixelUnsafe(Coord{ 0, coord_int(row) });
 
-// Filter one colour channel using previously calculated GuidedFilterValues
-static ImageGrey guidedFilterChannel(const ImageGrey& input, const GuidedFilterValues& v) {
-	const auto mean_p = boxFilter(input, v.radius);
+		std::fill(rowOut, rowOut + width, PixelT{});
 
-	const auto mean_Ip_r = boxFilter(v.I[0] * input, v.radius);
-	const auto mean_Ip_g = boxFilter(v.I[1] * input, v.radius);
-	const auto mean_Ip_b = boxFilter(v.I[2] * input, v.radius);
+		for (auto y = rows.first; y < rows.second; ++y) {
+			const PixelT* rowIn = &image.getPixelUnsafe(Coord{ 0, y });
 
-	const auto cov_Ip_r = mean_Ip_r - v.mean_I_r * mean_p;
-	const auto cov_Ip_g = mean_Ip_g - v.mean_I_g * mean_p;
-	const auto cov_Ip_b = mean_Ip_b - v.mean_I_b * mean_p;
+			for (coord_int x = 0; x < width; ++x) {
+				const auto columns = blockRange(size_t(x), subsample, image.width());
+				for (auto i = columns.first; i < columns.second; ++i) { rowOut[x] += rowIn[i]; }
+			}
+		}
+
+		for (coord_int x = 0; x < width; ++x) {
+			const auto columns = blockRange(size_t(x), subsample, image.width());
+			rowOut[x] /= float((rows.second - rows.first) * (columns.second - columns.first));
+		}
+	};
+
+	// By reference, as in forEachRangeParallel, so that std::function does not copy it to the heap
+	getThreadPool().parallelFor(size_t(height), std::cref(downsampleRow));
+}
+
+// Radius at a resolution subsample times lower covering about as many pixels as r, but at least one
+// unless r is zero, so that a subsampled filter still smooths.
+static size_t subsampledRadius(size_t r, size_t subsample) {
+	return r == 0 ? 0 : std::max(size_t(1), (r + subsample / 2) / subsample);
+}
+
+// Interpolations of the size pixels of a row or column from samples subsampled ones into out.
+static void getInterpolations(
+	coord_int size, coord_int samples, coord_int subsample, std::vector<Interpolation>& out
+) {
+	out.resize(size_t(size));
+
+	for (coord_int i = 0; i < size; ++i) {
+		const auto position = clamp(
+			(float(i) + 0.5f) / float(subsample) - 0.5f, 0.0f, float(samples - 1)
+		);
+		const auto lower = coord_int(position);
+
+		out[size_t(i)] = { lower, std::min(lower + 1, samples - 1), position - float(lower) };
+	}
+}
+
+// Guided filter output into channel c of out, of the size of guide, from the mean coefficients in
+// buffers.planes computed at a resolution subsample times lower. The coefficients are upsampled one
+// row at a time as they are applied, rather than into full resolution images of their own.
+template <typename PixelT>
+static void applyUpsampledCoefficients(
+	const ImageRgb& guide, coord_int subsample, BaseImage<PixelT>& out, size_t c,
+	GuidedFilterBuffers& buffers
+) {
+	const auto width = guide.width(), height = guide.height();
+	const auto& meanCoefficients = buffers.planes;
+	const auto samples = meanCoefficients[0].width();
+
+	if (out.data().empty()) { return; }
+
+	auto& columns = buffers.columns;
+	auto& rows = buffers.rows;
+	getInterpolations(width, samples, subsample, columns);
+	getInterpolations(height, meanCoefficients[0].height(), subsample, rows);
+
+	forEachRangeParallel(size_t(height), buffers.coefficientRows,
+		[&](std::vector<float>& coefficients, size_t begin, size_t end) {
+			coefficients.resize(meanCoefficients.size() * size_t(samples));
+
+			for (auto y = begin; y < end; ++y) {
+				// Interpolate between rows of coefficients once, then between columns per pixel.
+				const auto& interpolation = rows[y];
+
+				for (size_t k = 0; k < meanCoefficients.size(); ++k) {
+					const auto& plane = meanCoefficients[k];
+					const float* lower = &plane.getPixelUnsafe(Coord{ 0, interpolation.lower });
+					const float* upper = &plane.getPixelUnsafe(Coord{ 0, interpolation.upper });
+					float* row = &coefficients[k * size_t(samples)];
+
+					for (coord_int x = 0; x < samples; ++x) {
+						row[x] = lower[x] + interpolation.weight * (upper[x] - lower[x]);
+					}
+				}
+
+				const Pixel* rowGuide = &guide.getPixelUnsafe(Coord{ 0, coord_int(y) });
+				PixelT* rowOut = &out.getPixelUnsafe(Coord{ 0, coord_int(y) });
+
+				for (coord_int x = 0; x < width; ++x) {
+					const auto& column = columns[size_t(x)];
+					const auto at = [&](size_t k) {
+						const float a = coefficients[k * size_t(samples) + size_t(column.lower)];
+						const float b = coefficients[k * size_t(samples) + size_t(column.upper)];
+						return a + column.weight * (b - a);
+					};
+
+					channel(rowOut[x], c) = at(0) * rowGuide[x].r() + at(1) * rowGuide[x].g()
+						+ at(2) * rowGuide[x].b() + at(3);
+				}
+			}
+		}
+	);
+}
+
+//--------------------------------------------------------------------------------------------------
+
+GuidedFilterValues::GuidedFilterValues(const ImageRgb& guide, size_t r, float eps, size_t subsample)
+	: m_r(r), m_eps(eps), m_subsample(std::max(size_t(1), subsample))
+	, m_width(guide.width()), m_height(guide.height())
+	, m_windowSize(2 * (m_subsample > 1 ? subsampledRadius(r, m_subsample) : r) + 1)
+	, m_subsampledGuide(0, 0)
+	, m_statistics(0, 0)
+{
+	if (m_subsample > 1) { downsample(guide, coord_int(m_subsample), m_subsampledGuide); }
+
+	// Guide at the resolution filtered at
+	const auto& I = (m_subsample > 1) ? m_subsampledGuide : guide;
+	const auto width = I.width(), height = I.height();
+
+	m_statistics = BaseImage<GuideStatistics>{ width, height };
+	GuideStatistics* stats = m_statistics.data().data();
+
+	// The means of the channels and of their products are box filtered in two batches, the second
+	// reusing the memory of the first, and each folded into statistics as soon as it is done.
+	// Covariances are kept in place of their inverse terms until all are known.
+	std::vector<ImageGrey> planes;
+	BoxFilterBuffers<float> buffers;
+	std::array<const float*, 6> p;
+
+	boxFilterMany(width, height, {
+		rowsOfChannel(I, 0), rowsOfChannel(I, 1), rowsOfChannel(I, 2),
+		rowsOfChannelProduct(I, 0, 0), rowsOfChannelProduct(I, 0, 1), rowsOfChannelProduct(I, 0, 2)
+	}, m_windowSize, planes, buffers);
+
+	for (size_t i = 0; i < p.size(); ++i) { p[i] = planes[i].data().data(); }
+
+	forEachPixelParallel(width, height, [&](size_t i) {
+		const float mean_r = p[0][i], mean_g = p[1][i], mean_b = p[2][i];
+
+		stats[i].mean = {{ mean_r, mean_g, mean_b }};
+		stats[i].inv[0] = (p[3][i] - mean_r * mean_r) + eps;
+		stats[i].inv[1] =  p[4][i] - mean_r * mean_g;
+		stats[i].inv[2] =  p[5][i] - mean_r * mean_b;
+	});
+
+	boxFilterMany(width, height, {
+		rowsOfChannelProduct(I, 1, 1), rowsOfChannelProduct(I, 1, 2), rowsOfChannelProduct(I, 2, 2)
+	}, m_windowSize, planes, buffers);
+
+	forEachPixelParallel(width, height, [&](size_t i) {
+		const auto& mean = stats[i].mean;
+		const auto& inv = stats[i].inv;
+
+		stats[i].setInverse(inv[0], inv[1], inv[2],
+			(p[0][i] - mean[1] * mean[1]) + eps,
+			 p[1][i] - mean[1] * mean[2],
+			(p[2][i] - mean[2] * mean[2]) + eps
+		);
+	});
+}
 
-	const auto a_r = v.invrr * cov_Ip_r + v.invrg * cov_Ip_g + v.invrb * cov_Ip_b;
-	const auto a_g = v.invrg * cov_Ip_r + v.invgg * cov_Ip_g + v.invgb * cov_Ip_b;
-	const auto a_b = v.invrb * cov_Ip_r + v.invgb * cov_Ip_g + v.invbb * cov_Ip_b;
+ImageGrey GuidedFilterValues::filter(const ImageGrey& input, const ImageRgb& guide) const {
+	ImageGrey out{ 0, 0 };
+	GuidedFilterBuffers buffers;
 
-	const auto b = mean_p - a_r * v.mean_I_r - a_g * v.mean_I_g - a_b * v.mean_I_b;
+	filter(input, guide, out, buffers);
 
-	return boxFilter(a_r, v.radius) * v.I[0]
-		 + boxFilter(a_g, v.radius) * v.I[1]
-		 + boxFilter(a_b, v.radius) * v.I[2]
-		 + boxFilter(b,   v.radius);
+	return out;
+}
+
+ImageRgb GuidedFilterValues::filter(const ImageRgb& input, const ImageRgb& guide) const {
+	ImageRgb out{ 0, 0 };
+	GuidedFilterBuffers buffers;
+
+	filter(input, guide, out, buffers);
+
+	return out;
+}
+
+void GuidedFilterValues::filter(
+	const ImageGrey& input, const ImageRgb& guide, ImageGrey& out, GuidedFilterBuffers& buffers
+) const {
+	filterChannels(input, guide, out, buffers.downsampledGrey, buffers);
+}
+
+void GuidedFilterValues::filter(
+	const ImageRgb& input, const ImageRgb& guide, ImageRgb& out, GuidedFilterBuffers& buffers
+) const {
+	filterChannels(input, guide, out, buffers.downsampledRgb, buffers);
+}
+
+void GuidedFilterValues::checkSizes(
+	coord_int width, coord_int height, const ImageRgb& guide
+) const {
+	if (width != m_width || height != m_height || guide.width() != m_width
+		|| guide.height() != m_height
+	) {
+		throw ImageError{ "Guided filter of an image or with a guide of a different size." };
+	}
+}
+
+template <typename PixelT>
+void GuidedFilterValues::filterChannels(
+	const BaseImage<PixelT>& input, const ImageRgb& guide, BaseImage<PixelT>& out,
+	BaseImage<PixelT>& downsampled, GuidedFilterBuffers& buffers
+) const {
+	checkSizes(input.width(), input.height(), guide);
+
+	const auto s = coord_int(m_subsample);
+
+	// Downsampled before out is written, which may be input
+	if (m_subsample > 1) { downsample(input, s, downsampled); }
+
+	const auto& in = (m_subsample > 1) ? downsampled : input;
+
+	if (out.width() != m_width || out.height() != m_height) {
+		out = BaseImage<PixelT>{ m_width, m_height };
+	}
+
+	// Each channel of out is written once the channel of input has been read for the last time.
+	constexpr size_t channels = sizeof(PixelT) / sizeof(float);
+
+	for (size_t c = 0; c < channels; ++c) {
+		if (m_subsample > 1) {
+			getMeanCoefficients(in, c, m_subsampledGuide, buffers);
+			applyUpsampledCoefficients(guide, s, out, c, buffers);
+			continue;
+		}
+
+		getMeanCoefficients(in, c, guide, buffers);
+
+		const auto& p = buffers.planes;
+
+		forEachPixelParallel(m_width, m_height, [&](size_t i) {
+			const auto& I = guide.data()[i];
+
+			channel(out.data()[i], c) = p[0].data()[i] * I.r() + p[1].data()[i] * I.g()
+				+ p[2].data()[i] * I.b() + p[3].data()[i];
+		});
+	}
+}
+
+template <typename PixelT>
+void GuidedFilterValues::getMeanCoefficients(
+	const BaseImage<PixelT>& input, size_t c, const ImageRgb& I, GuidedFilterBuffers& buffers
+) const {
+	const auto width = input.width(), height = input.height();
+	const auto windowSize = coord_int(m_windowSize);
+	auto& planes = buffers.planes;
+
+	resizePlanes(width, height, 4, planes);
+
+	// boxFilterPlanes is called directly, rather than through boxFilterMany, so that rows are
+	// generated without a RowSource per plane, which would allocate on every call.
+	boxFilterPlanes(windowSize, [&](size_t plane, coord_int y, float* buffer) {
+		const PixelT* rowInput = &input.getPixelUnsafe(Coord{ 0, y });
+		const Pixel* rowI = &I.getPixelUnsafe(Coord{ 0, y });
+
+		if (plane == 0) {
+			for (coord_int x = 0; x < width; ++x) { buffer[x] = channel(rowInput[x], c); }
+		} else {
+			for (coord_int x = 0; x < width; ++x) {
+				buffer[x] = rowI[x].values[plane - 1] * channel(rowInput[x], c);
+			}
+		}
+
+		return static_cast<const float*>(buffer);
+	}, planes, buffers.boxFilter);
+
+	std::array<float*, 4> p;
+	for (size_t i = 0; i < p.size(); ++i) { p[i] = planes[i].data().data(); }
+
+	const GuideStatistics* stats = m_statistics.data().data();
+
+	forEachPixelParallel(width, height, [&](size_t i) {
+		const auto coefficients = stats[i].coefficients(p[0][i], p[1][i], p[2][i], p[3][i]);
+		for (size_t k = 0; k < p.size(); ++k) { p[k][i] = coefficients[k]; }
+	});
+
+	boxFilterPlanes(windowSize, [&](size_t plane, coord_int y, float*) {
+		return static_cast<const float*>(&planes[plane].getPixelUnsafe(Coord{ 0, y }));
+	}, planes, buffers.boxFilter);
 }
 
 // Filter a greyscale image
-ImageGrey guidedFilter(const ImageGrey& input, const ImageRgb& guide, size_t r, float eps) {
-	GuidedFilterValues v{ guide, r, eps };
-	return guidedFilterChannel(input, v);
+ImageGrey guidedFilter(
+	const ImageGrey& input, const ImageRgb& guide, size_t r, float eps, size_t subsample
+) {
+	return GuidedFilterValues{ guide, r, eps, subsample }.filter(input, guide);
+}
+
+// Filter a colour image, calculating reusable values first, then filtering per channel
+ImageRgb guidedFilter(
+	const ImageRgb& input, const ImageRgb& guide, size_t r, float eps, size_t subsample
+) {
+	return GuidedFilterValues{ guide, r, eps, subsample }.filter(input, guide);
 }
 
-// Filter a colour image
-ImageRgb guidedFilter(const ImageRgb& input, const ImageRgb& guide, size_t r, float eps) {
-	// Calculate reusable values first
-	GuidedFilterValues v{ guide, r, eps };
+//--------------------------------------------------------------------------------------------------
+// Streaming guided filter: the box filters of guidedFilter become vertical windows sliding down
+// rows of statistics, which are produced and used up row by row.
+//--------------------------------------------------------------------------------------------------
+
+// Box filter numRows rows of width floats, stored one after another in rows, horizontally in place,
+// FloatVec::lanes() rows at a time. The last block of rows is padded by repeating the last row.
+static void boxFilterRowsInPlace(
+	float* rows, size_t numRows, coord_int width, coord_int windowSize, std::vector<float>& buffer
+) {
+	constexpr auto lanes = simd::FloatVec::lanes();
+
+	for (size_t first = 0; first < numRows; first += lanes) {
+		float* block[lanes];
+
+		for (size_t lane = 0; lane < lanes; ++lane) {
+			block[lane] = rows + std::min(first + lane, numRows - 1) * size_t(width);
+		}
+
+		boxFilterRowBlock<1>(block, block, width, windowSize, buffer);
+	}
+}
+
+void guidedFilterRows(
+	coord_int width, coord_int height, const RowSource& input, const PixelRowSource& guide,
+	size_t r, float eps, const RowSink& output
+) {
+	if (width <= 0 || height <= 0) { return; }
+
+	const auto windowSize = coord_int(r * 2 + 1);
+	const auto halfWindowSize = windowSize / 2;
+	const auto n = size_t(width);
+
+	// Rows of statistics are planes of n floats each: the guide channels, their products rr, rg,
+	// rb, gg, gb, bb, the input and its products with the guide channels. Their means give the
+	// coefficients of the linear model, whose means give the output.
+	constexpr size_t numStatistics = 13;
+	constexpr size_t numCoefficients = 4;
+
+	std::vector<float> statisticsRow, coefficientsRow, inputRow, outputRow, buffer;
+	statisticsRow.resize(numStatistics * n);
+	coefficientsRow.resize(numCoefficients * n);
+	inputRow.resize(n);
+	outputRow.resize(n);
+
+	// Ring of the guide rows not yet output, output row y being made from guide row y.
+	std::vector<Pixel> guideRows;
+	guideRows.resize(size_t(windowSize) * n);
+
+	ColumnBoxFilter<float> statistics{ numStatistics * n, height, windowSize };
+	ColumnBoxFilter<float> coefficients{ numCoefficients * n, height, windowSize };
+
+	// Slide the window of coefficients to row o, and output row o - windowSize / 2 once known.
+	const auto stepCoefficients = [&](coord_int o, const float* added) {
+		float* means = (o >= halfWindowSize) ? coefficientsRow.data() : nullptr;
+		coefficients.step(o, added, means);
+
+		if (!means) { return; }
 
-	auto channels = splitChannels(input);
+		const auto y = o - halfWindowSize;
+		const Pixel* I = &guideRows[size_t(y % windowSize) * n];
 
-	// Then filter per channel
-	for (size_t i = 0; i < channels.size(); ++i) {
-		channels[i] = guidedFilterChannel(channels[i], v);
+		for (size_t x = 0; x < n; ++x) {
+			outputRow[x] = means[x] * I[x].r() + means[n + x] * I[x].g()
+				+ means[2 * n + x] * I[x].b() + means[3 * n + x];
+		}
+
+		output(y, outputRow.data());
+	};
+
+	// Slide the window of statistics to row o, and once the means of row o - windowSize / 2 are
+	// known, add its coefficients to theirs.
+	const auto stepStatistics = [&](coord_int o, const float* added) {
+		float* means = (o >= halfWindowSize) ? statisticsRow.data() : nullptr;
+		statistics.step(o, added, means);
+
+		if (!means) { return; }
+
+		const float* m[numStatistics];
+		for (size_t i = 0; i < numStatistics; ++i) { m[i] = means + i * n; }
+
+		for (size_t x = 0; x < n; ++x) {
+			GuideStatistics stats;
+			stats.mean = {{ m[0][x], m[1][x], m[2][x] }};
+
+			const auto& mean = stats.mean;
+
+			stats.setInverse(
+				(m[3][x] - mean[0] * mean[0]) + eps,
+				 m[4][x] - mean[0] * mean[1],
+				 m[5][x] - mean[0] * mean[2],
+				(m[6][x] - mean[1] * mean[1]) + eps,
+				 m[7][x] - mean[1] * mean[2],
+				(m[8][x] - mean[2] * mean[2]) + eps
+			);
+
+			const auto c = stats.coefficients(m[9][x], m[10][x], m[11][x], m[12][x]);
+			for (size_t i = 0; i < numCoefficients; ++i) { coefficientsRow[i * n + x] = c[i]; }
+		}
+
+		boxFilterRowsInPlace(coefficientsRow.data(), numCoefficients, width, windowSize, buffer);
+
+		const auto y = o - halfWindowSize;
+		stepCoefficients(y, coefficientsRow.data());
+
+		// The bottom rows of coefficients are all known, so flush the rest of the output.
+		if (y + 1 == height) {
+			for (auto flushed = height; flushed < height + halfWindowSize; ++flushed) {
+				stepCoefficients(flushed, nullptr);
+			}
+		}
+	};
+
+	for (coord_int y = 0; y < height; ++y) {
+		Pixel* I = &guideRows[size_t(y % windowSize) * n];
+		const Pixel* guideRow = guide(y, I);
+		if (guideRow != I) { std::copy(guideRow, guideRow + n, I); }
+
+		const float* p = input(y, inputRow.data());
+		float* s[numStatistics];
+		for (size_t i = 0; i < numStatistics; ++i) { s[i] = &statisticsRow[i * n]; }
+
+		for (size_t x = 0; x < n; ++x) {
+			const float I_r = I[x].r(), I_g = I[x].g(), I_b = I[x].b();
+
+			s[0][x] = I_r;
+			s[1][x] = I_g;
+			s[2][x] = I_b;
+			s[3][x] = I_r * I_r;
+			s[4][x] = I_r * I_g;
+			s[5][x] = I_r * I_b;
+			s[6][x] = I_g * I_g;
+			s[7][x] = I_g * I_b;
+			s[8][x] = I_b * I_b;
+			s[9][x] = p[x];
+			s[10][x] = I_r * p[x];
+			s[11][x] = I_g * p[x];
+			s[12][x] = I_b * p[x];
+		}
+
+		boxFilterRowsInPlace(statisticsRow.data(), numStatistics, width, windowSize, buffer);
+		stepStatistics(y, statisticsRow.data());
 	}
 
-	return joinChannels(channels[0], channels[1], channels[2]);
+	for (auto o = height; o < height + halfWindowSize; ++o) { stepStatistics(o, nullptr); }
 }
 
 }} // namespace ImgProc::filters
-
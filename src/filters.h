@@ -1,6 +1,13 @@
 #pragma once
 
+#include <array>
+#include <functional>
+#include <limits>
+#include <vector>
+
 #include "image.h"
+#include "simd.h"
+#include "thread_pool.h"
 #include "util.h"
 
 namespace ImgProc {
@@ -8,15 +15,273 @@ namespace ImgProc {
 /** Image processing filters. */
 namespace filters {
 
-/** O(n) implementation of box filter. */
+/** O(n) implementation of box filter. 8-bit and 16-bit integer images (uint8_t, uint16_t and
+ * PixelRgb8 pixels) are filtered in integer arithmetic, with exact sums and means rounded to nearest
+ * after each pass, exactly so for windows of up to 8192 pixels. Float running sums are periodically
+ * recomputed, so that their rounding errors stay bounded however long the rows and columns are.
+ * Blocks of rows and strips of columns are filtered in parallel on the shared thread pool, and are
+ * the same whatever the number of threads, so results are too.
+ */
 template <typename PixelT>
 BaseImage<PixelT> boxFilter(const BaseImage<PixelT>& image, size_t r);
 
-/** Single-channel guided filter. */
-ImageGrey guidedFilter(const ImageGrey& input, const ImageRgb& guide, size_t r, float eps);
+/** Box filter reusing the memory of image, which it filters in place. */
+template <typename PixelT>
+BaseImage<PixelT> boxFilter(BaseImage<PixelT>&& image, size_t r);
+
+/** Working memory of boxFilter, which can be kept between calls so that it is only allocated once.
+ * Grows to fit the largest image filtered with it.
+ */
+template <typename PixelT>
+struct BoxFilterBuffers;
+
+/** Box filter into out, which is resized to the size of image unless it already has that size, and
+ * may be image itself. Filtering images of the same size over and over with the same out and
+ * buffers allocates no image or working memory after the first call; only the shared thread pool
+ * still allocates a few bytes per parallel pass when it has more than one thread.
+ */
+template <typename PixelT>
+void boxFilter(
+	const BaseImage<PixelT>& image, size_t r, BaseImage<PixelT>& out, BoxFilterBuffers<PixelT>& buffers
+);
+
+/** Box filter over region of image, which must lie within it, as views returned by
+ * BaseImage::getView do, returning an image of the region's size. Pixels around the region are read
+ * as far as windows reach, so windows are only clipped at the edges of image, and results equal
+ * those of filtering the whole image within the region, exactly for integer images and up to
+ * rounding for float ones. Nothing is copied out of image beforehand.
+ */
+template <typename PixelT>
+BaseImage<PixelT> boxFilter(const BaseImage<PixelT>& image, const ImageView& region, size_t r);
+
+/** Box filter over region of image into out, as above, which is resized to the region's size
+ * unless it already has that size. out may be image itself only if region covers all of it.
+ */
+template <typename PixelT>
+void boxFilter(
+	const BaseImage<PixelT>& image, const ImageView& region, size_t r, BaseImage<PixelT>& out,
+	BoxFilterBuffers<PixelT>& buffers
+);
+
+/** Source of the rows of a plane for boxFilterMany. Returns a pointer to row y, either the plane's
+ * own storage or buffer (with room for one row) filled with the row. Allows planes computed from
+ * others, e.g. products, to be generated row by row instead of being held in memory in full. May be
+ * called concurrently for different rows.
+ */
+using RowSource = std::function<const float*(coord_int y, float* buffer)>;
+
+/** Rows of an image. */
+RowSource rowsOf(const ImageGrey& image);
+
+/** Source of the rows of a colour image, as RowSource. */
+using PixelRowSource = std::function<const Pixel*(coord_int y, Pixel* buffer)>;
+
+/** Rows of a colour image. */
+PixelRowSource rowsOf(const ImageRgb& image);
 
-/** RGB guided filter. */
-ImageRgb guidedFilter(const ImageRgb& input, const ImageRgb& guide, size_t r, float eps);
+/** Receiver of row y of a greyscale image. The row is only valid during the call. */
+using RowSink = std::function<void(coord_int y, const float* row)>;
+
+/** Rows of the per-pixel product of two images of the same size. */
+RowSource rowsOfProduct(const ImageGrey& a, const ImageGrey& b);
+
+/** Box filters several planes of width x height floats together, generating source rows straight
+ * into the output images, and sharing the work on all planes between the threads of the shared
+ * pool. Results equal those of boxFilter with the same window size on each plane.
+ */
+std::vector<ImageGrey> boxFilterMany(
+	coord_int width, coord_int height, const std::vector<RowSource>& planes, size_t windowSize
+);
+
+/** boxFilterMany into out, which is resized to hold one image of width x height per plane, reusing
+ * the images already there that have that size, with working memory in buffers. Filtering planes of
+ * the same size over and over with the same out and buffers allocates no image or working memory
+ * after the first call, as with boxFilter. Only the RowSources of planes themselves may allocate.
+ */
+void boxFilterMany(
+	coord_int width, coord_int height, const std::vector<RowSource>& planes, size_t windowSize,
+	std::vector<ImageGrey>& out, BoxFilterBuffers<float>& buffers
+);
+
+/** Square min filter (erosion) for scalar pixel types, O(1) per pixel regardless of window size.
+ * Windows overlapping the top / left image border are shifted inwards, windows overlapping the
+ * bottom / right border are clamped to the border.
+ */
+template <typename PixelT>
+BaseImage<PixelT> minFilter(const BaseImage<PixelT>& image, size_t windowSize);
+
+/** Min filter over region of image, which must lie within it, returning an image of the region's
+ * size. Results equal those of filtering the whole image within the region, as pixels around the
+ * region are read as far as windows reach.
+ */
+template <typename PixelT>
+BaseImage<PixelT> minFilter(
+	const BaseImage<PixelT>& image, const ImageView& region, size_t windowSize
+);
+
+/** Single-channel guided filter. With subsample s > 1, runs as the fast guided filter: the linear
+ * coefficients are computed on input and guide downsampled by s in each dimension, with radius
+ * r / s (at least 1), then bilinearly upsampled and applied to the full resolution guide. Takes
+ * about 1/s^2 of the time of the full resolution filter, for output that differs little from it.
+ */
+ImageGrey guidedFilter(
+	const ImageGrey& input, const ImageRgb& guide, size_t r, float eps, size_t subsample = 1
+);
+
+/** RGB guided filter, subsampled as above. */
+ImageRgb guidedFilter(
+	const ImageRgb& input, const ImageRgb& guide, size_t r, float eps, size_t subsample = 1
+);
+
+/** Means of the guide channels over the window around a pixel, and the inverse of their covariance
+ * matrix plus eps times identity. The inverse is symmetric, so only its upper triangle is kept.
+ */
+struct GuideStatistics {
+	std::array<float, 3> mean; // r, g, b
+	std::array<float, 6> inv; // rr, rg, rb, gg, gb, bb
+
+	/** Set inv to the inverse of the covariance matrix with the given terms, eps included. */
+	void setInverse(
+		float var_rr, float var_rg, float var_rb, float var_gg, float var_gb, float var_bb
+	) {
+		const float inv_rr = var_gg * var_bb - var_gb * var_gb;
+		const float inv_rg = var_gb * var_rb - var_rg * var_bb;
+		const float inv_rb = var_rg * var_gb - var_gg * var_rb;
+		const float inv_gg = var_rr * var_bb - var_rb * var_rb;
+		const float inv_gb = var_rb * var_rg - var_rr * var_gb;
+		const float inv_bb = var_rr * var_gg - var_rg * var_rg;
+
+		const float covDet = inv_rr * var_rr + inv_rg * var_rg + inv_rb * var_rb;
+
+		inv = {{
+			inv_rr / covDet, inv_rg / covDet, inv_rb / covDet,
+			inv_gg / covDet, inv_gb / covDet, inv_bb / covDet
+		}};
+	}
+
+	/** Coefficients a_r, a_g, a_b and b of the linear model, in terms of the guide, of an input
+	 * whose mean is mean_p, and whose products with the guide channels have means mean_Ip_*.
+	 */
+	std::array<float, 4> coefficients(
+		float mean_p, float mean_Ip_r, float mean_Ip_g, float mean_Ip_b
+	) const {
+		const float cov_Ip_r = mean_Ip_r - mean[0] * mean_p;
+		const float cov_Ip_g = mean_Ip_g - mean[1] * mean_p;
+		const float cov_Ip_b = mean_Ip_b - mean[2] * mean_p;
+
+		const float a_r = inv[0] * cov_Ip_r + inv[1] * cov_Ip_g + inv[2] * cov_Ip_b;
+		const float a_g = inv[1] * cov_Ip_r + inv[3] * cov_Ip_g + inv[4] * cov_Ip_b;
+		const float a_b = inv[2] * cov_Ip_r + inv[4] * cov_Ip_g + inv[5] * cov_Ip_b;
+
+		return {{ a_r, a_g, a_b, mean_p - a_r * mean[0] - a_g * mean[1] - a_b * mean[2] }};
+	}
+};
+
+/** Working memory of GuidedFilterValues::filter, which can be kept between calls so that it is
+ * only allocated once, one per thread filtering concurrently. Grows to fit the largest image
+ * filtered with it.
+ */
+struct GuidedFilterBuffers;
+
+/** Intermediate results of guided filter that depend only on the guide and parameters, computed
+ * once and reusable for filtering any number of images with the same guide, e.g. the transmission
+ * map and each frame of a sequence shot from a fixed camera. Filtering with them skips the six box
+ * filters of the guide statistics, about half the work of guidedFilter for a greyscale input.
+ * Holds GuideStatistics for each pixel filtered (36 bytes), and with subsample s > 1 the guide
+ * downsampled by s too, but not the guide itself, which is passed to filter. Immutable once
+ * constructed, so can be shared between threads filtering concurrently.
+ */
+class GuidedFilterValues {
+public:
+	/** Values of guided filter with guide, radius r and eps, subsampled as guidedFilter is. */
+	GuidedFilterValues(const ImageRgb& guide, size_t r, float eps, size_t subsample = 1);
+
+	/** Filter input with guide, which must be the guide the values were computed from. Equals
+	 * guidedFilter with the same guide and parameters. Throws ImageError if input or guide differ
+	 * in size from that guide.
+	 */
+	ImageGrey filter(const ImageGrey& input, const ImageRgb& guide) const;
+
+	/** Filter each channel of input as above. */
+	ImageRgb filter(const ImageRgb& input, const ImageRgb& guide) const;
+
+	/** filter into out, which is resized to the size of the guide unless it already has that size,
+	 * and may be input itself, with working memory in buffers. Filtering images over and over with
+	 * the same out and buffers allocates no image or working memory after the first call, as with
+	 * boxFilter.
+	 */
+	void filter(
+		const ImageGrey& input, const ImageRgb& guide, ImageGrey& out, GuidedFilterBuffers& buffers
+	) const;
+
+	/** Filter each channel of input as above. out must not be guide. */
+	void filter(
+		const ImageRgb& input, const ImageRgb& guide, ImageRgb& out, GuidedFilterBuffers& buffers
+	) const;
+
+	/** Get width of the guide. */
+	coord_int width() const { return m_width; }
+
+	/** Get height of the guide. */
+	coord_int height() const { return m_height; }
+
+	/** Get radius of the filter. */
+	size_t r() const { return m_r; }
+
+	/** Get regularisation term of the filter. */
+	float eps() const { return m_eps; }
+
+	/** Get subsampling ratio, 1 if not subsampled. */
+	size_t subsample() const { return m_subsample; }
+
+private:
+	void checkSizes(coord_int width, coord_int height, const ImageRgb& guide) const;
+
+	// Filter each channel of input into out, downsampling input into downsampled first if
+	// subsampled.
+	template <typename PixelT>
+	void filterChannels(
+		const BaseImage<PixelT>& input, const ImageRgb& guide, BaseImage<PixelT>& out,
+		BaseImage<PixelT>& downsampled, GuidedFilterBuffers& buffers
+	) const;
+
+	// Box filtered coefficients a_r, a_g, a_b and b of the linear model of channel c of input in
+	// terms of guide I into buffers.planes. The means of the channel and of its products with I are
+	// box filtered into the planes, turned into the coefficients in place, then box filtered again
+	// in place.
+	template <typename PixelT>
+	void getMeanCoefficients(
+		const BaseImage<PixelT>& input, size_t c, const ImageRgb& I, GuidedFilterBuffers& buffers
+	) const;
+
+	size_t m_r;
+	float m_eps;
+	size_t m_subsample;
+	coord_int m_width, m_height;
+	size_t m_windowSize; // At the resolution filtered at
+
+	ImageRgb m_subsampledGuide; // Empty unless subsampled
+	BaseImage<GuideStatistics> m_statistics;
+};
+
+/** Streaming single-channel guided filter of a width x height image, for images too tall to hold
+ * whole, such as long scans, or rows arriving one at a time. Rows y of input and guide are read in
+ * order from top to bottom, once each, and row y of the output is passed to output as soon as rows
+ * up to y + 2r have been read. In between, the statistics of the rows are box filtered in rings of
+ * 2r + 1 rows, taking about 80 (2r + 1) bytes per pixel of width whatever the height. Results equal
+ * those of guidedFilter up to rounding. Runs on the calling thread.
+ */
+void guidedFilterRows(
+	coord_int width, coord_int height, const RowSource& input, const PixelRowSource& guide,
+	size_t r, float eps, const RowSink& output
+);
+
+/** Normalises greyscale image whose lowest value is min and highest is max, such that min becomes
+ * 0.0f and max becomes 1.0f. For use when the range is already known, saving a pass over the image.
+ */
+inline void normalise(ImageGrey& img, float min, float max) {
+	for (auto& p : img.data()) { p = (p - min) / (max - min); }
+}
 
 /** Normalises greyscale image such that lowest value becomes 0.0f and highest becomes 1.0f */
 inline void normalise(ImageGrey& img) {
@@ -28,7 +293,7 @@ inline void normalise(ImageGrey& img) {
 		max = std::max(max, p);
 	}
 
-	for (auto& p : img.data()) { p = (p - min) / (max - min); }
+	normalise(img, min, max);
 }
 
 }} // namespace ImgProc::filters
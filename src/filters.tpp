@@ -1,68 +1,1159 @@
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <functional>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace ImgProc { namespace filters {
 
-// Horizontal or vertical pass of box filter.
-// Templated on direction, allowing compiler to optimise out branches based on direction.
-template <bool vertical, typename PixelT>
-void boxFilterPass(BaseImage<PixelT>& image, coord_int windowSize) {
-	const auto halfWindowSize = windowSize / 2;
-	const auto outerSize = vertical ? coord_int(image.width())  : coord_int(image.height());
-	const auto innerSize = vertical ? coord_int(image.height()) : coord_int(image.width());
+// Execution helper for 1D stencil kernels, running positions [0, count) of a kernel whose position
+// i reads elements [i - before, i + after] of a line of size elements. Ranges of positions where all
+// of those elements lie within the line are passed to interior(begin, end), which may then access
+// them without bounds checks or clamping. The remaining positions near either end of the line are
+// passed to border(begin, end). Ranges are passed in ascending order, so kernels may carry state
+// from one position to the next.
+template <typename Interior, typename Border>
+void forInteriorAndBorder(
+	coord_int count, coord_int size, coord_int before, coord_int after,
+	Interior interior, Border border
+) {
+	const auto interiorBegin = std::min(before, count);
+	const auto interiorEnd = std::max(interiorBegin, std::min(count, size - after));
+
+	if (interiorBegin > 0) { border(coord_int(0), interiorBegin); }
+	if (interiorEnd > interiorBegin) { interior(interiorBegin, interiorEnd); }
+	if (count > interiorEnd) { border(interiorEnd, count); }
+}
 
-	std::vector<PixelT> rowOrColumn;
-	rowOrColumn.resize(size_t(innerSize));
+// Interval in positions at which the vectorised box filters recompute float running sums from the
+// elements in the window. Rounding errors of the sums would otherwise build up along the whole of a
+// row or column, enough to show in very long ones. Recomputing takes at most 1 / 16 more additions.
+inline coord_int boxFilterResyncInterval(coord_int windowSize) {
+	return std::max(coord_int(1024), 8 * windowSize);
+}
 
-	// For each row / column
-	for (coord_int i = 0; i < outerSize; ++i) {
-		auto accum = PixelT{};
-		int weight = 0;
+// Box filter over one row / column of n elements spaced stride elements apart in memory.
+template <typename PixelT>
+void boxFilterLine(
+	const PixelT* in, ptrdiff_t stride, PixelT* out, coord_int n, coord_int windowSize
+) {
+	const auto halfWindowSize = windowSize / 2;
 
-		// Slide window over column / row, calculating accumulated value in window  by subtracting
-		// element that the window just left behind and adding element that the window just passed
-		// over - two arithmetic operations per iteration. Also track 'weight', number of elements
-		// accumulated, so mean can be found by dividing the accumulation by weight.
+	auto accum = PixelT{};
+	int weight = 0;
 
-		for (coord_int o = 0; o < innerSize + halfWindowSize; ++o) {
+	// Slide window over column / row, calculating accumulated value in window  by subtracting
+	// element that the window just left behind and adding element that the window just passed
+	// over - two arithmetic operations per iteration. Also track 'weight', number of elements
+	// accumulated, so mean can be found by dividing the accumulation by weight.
+	// Position o adds element o and removes element o - windowSize.
+
+	auto border = [&](coord_int begin, coord_int end) {
+		for (coord_int o = begin; o < end; ++o) {
 			if (o < windowSize) { ++weight; }
-			else {
-				// Remove value that left window
-				auto oldCoord = vertical ? Coord{i, o - windowSize} : Coord{o - windowSize, i};
-				accum -= image[oldCoord];
-			}
+			else { accum -= in[(o - windowSize) * stride]; } // Remove value that left window
 
-			if (o < innerSize) {
-				// Add value that entered window
-				auto newCoord = vertical ? Coord{i, o} : Coord{o, i};
-				accum += image[newCoord];
-			}
+			if (o < n) { accum += in[o * stride]; } // Add value that entered window
 			else { --weight; }
 
 			// Set output to mean value of window.
+			if (o >= halfWindowSize) { out[o - halfWindowSize] = accum / float(weight); }
+		}
+	};
+
+	// Window entirely within line, weight is windowSize.
+	auto interior = [&](coord_int begin, coord_int end) {
+		const PixelT* added = in + begin * stride;
+		const PixelT* removed = added - windowSize * stride;
+		PixelT* mean = out + (begin - halfWindowSize);
+
+		for (coord_int o = begin; o < end; ++o) {
+			accum -= *removed;
+			accum += *added;
+			*mean++ = accum / float(weight);
+
+			removed += stride;
+			added += stride;
+		}
+	};
+
+	forInteriorAndBorder(n + halfWindowSize, n, windowSize, 0, interior, border);
+}
+
+// Element type box filters work on. Multi-channel pixels are worked on as their channels.
+template <typename PixelT>
+struct BoxFilterElement { using type = PixelT; };
+
+template <>
+struct BoxFilterElement<Pixel> { using type = float; };
+
+template <>
+struct BoxFilterElement<PixelRgb8> { using type = uint8_t; };
+
+// Type box filters sum elements of type T in. Integer sums are exact, for windows of up to 65537
+// elements even if 16-bit.
+template <typename T>
+struct BoxFilterSum { using type = T; };
+
+template <>
+struct BoxFilterSum<uint8_t> { using type = uint32_t; };
+
+template <>
+struct BoxFilterSum<uint16_t> { using type = uint32_t; };
+
+// Mean of integer elements from their sum over weight elements, rounded to nearest. Rather than
+// dividing, sums are multiplied by a fixed-point reciprocal of the weight, rounded up to 32 bits,
+// with 31 + floor(log2(weight)) fractional bits. The error this adds to the mean is below
+// sum / 2^(shift - 1) / weight, too little to change the rounding as long as sums are below 2^29,
+// i.e. for weights of up to 8192 16-bit elements or 2 million 8-bit elements.
+class IntegerMean {
+public:
+	explicit IntegerMean(int weight) {
+		while ((uint64_t(2) << m_shift) <= uint64_t(weight) << 31) { ++m_shift; }
+		m_factor = uint32_t(((uint64_t(1) << m_shift) + uint64_t(weight) - 1) / uint64_t(weight));
+	}
+
+	uint32_t operator()(uint32_t sum) const {
+		return uint32_t((uint64_t(sum) * m_factor + (uint64_t(1) << (m_shift - 1))) >> m_shift);
+	}
+
+	simd::Uint32Vec operator()(simd::Uint32Vec sums) const {
+		return mulShiftRound(sums, m_factor, m_shift);
+	}
+
+private:
+	uint32_t m_factor;
+	unsigned m_shift = 31;
+};
+
+// Box filter over one row of n pixels of channels integer elements each, with exact sums and means
+// rounded to nearest. Otherwise the same as boxFilterLine. in and out must not alias.
+template <size_t channels, typename T>
+void boxFilterLineInteger(const T* in, T* out, coord_int n, coord_int windowSize) {
+	const auto halfWindowSize = windowSize / 2;
+
+	std::array<uint32_t, channels> accum{};
+	int weight = 0;
+
+	auto border = [&](coord_int begin, coord_int end) {
+		for (coord_int o = begin; o < end; ++o) {
+			for (size_t c = 0; c < channels; ++c) {
+				if (o >= windowSize) { accum[c] -= in[size_t(o - windowSize) * channels + c]; }
+				if (o < n) { accum[c] += in[size_t(o) * channels + c]; }
+			}
+
+			weight += int(o < windowSize) - int(o >= n);
+
 			if (o >= halfWindowSize) {
-				rowOrColumn[size_t(o - halfWindowSize)] = accum / float(weight);
+				const IntegerMean mean{ weight };
+				for (size_t c = 0; c < channels; ++c) {
+					out[size_t(o - halfWindowSize) * channels + c] = T(mean(accum[c]));
+				}
+			}
+		}
+	};
+
+	// Window entirely within line, weight is windowSize.
+	auto interior = [&](coord_int begin, coord_int end) {
+		const IntegerMean mean{ windowSize };
+		const T* added = in + size_t(begin) * channels;
+		const T* removed = added - size_t(windowSize) * channels;
+		T* means = out + size_t(begin - halfWindowSize) * channels;
+
+		for (coord_int o = begin; o < end; ++o) {
+			for (size_t c = 0; c < channels; ++c) {
+				accum[c] -= *removed++;
+				accum[c] += *added++;
+				*means++ = T(mean(accum[c]));
+			}
+		}
+	};
+
+	forInteriorAndBorder(n + halfWindowSize, n, windowSize, 0, interior, border);
+}
+
+// Box filter over one row of n pixels from in to out, which must not alias. Integer pixel types are
+// filtered in integer arithmetic.
+template <typename PixelT>
+void boxFilterRow(const PixelT* in, PixelT* out, coord_int n, coord_int windowSize) {
+	boxFilterLine(in, 1, out, n, windowSize);
+}
+
+inline void boxFilterRow(const uint8_t* in, uint8_t* out, coord_int n, coord_int windowSize) {
+	boxFilterLineInteger<1>(in, out, n, windowSize);
+}
+
+inline void boxFilterRow(const uint16_t* in, uint16_t* out, coord_int n, coord_int windowSize) {
+	boxFilterLineInteger<1>(in, out, n, windowSize);
+}
+
+inline void boxFilterRow(const PixelRgb8* in, PixelRgb8* out, coord_int n, coord_int windowSize) {
+	static_assert(sizeof(PixelRgb8) == 3, "PixelRgb8 must be tightly packed.");
+
+	boxFilterLineInteger<3>(
+		reinterpret_cast<const uint8_t*>(in), reinterpret_cast<uint8_t*>(out), n, windowSize
+	);
+}
+
+template <typename PixelT>
+struct BoxFilterWorkspace;
+
+// Horizontal pass of box filter, filtering rows [beginY, endY) of view, a region of in, into the
+// same rows of out, which is the size of view. Rows are filtered as if view's edges were the
+// image's. out may be in itself if view covers all of it. Specialised for float and Pixel below.
+template <typename PixelT>
+void boxFilterHorizontalPass(
+	const BaseImage<PixelT>& in, const ImageView& view, BaseImage<PixelT>& out, coord_int windowSize,
+	coord_int beginY, coord_int endY, BoxFilterWorkspace<PixelT>& workspace
+) {
+	const auto width = view.width();
+
+	if (width <= 0) { return; }
+
+	// Filtering in place overwrites elements still to be removed from the window, so go via a copy.
+	const bool inPlace = (&in == &out);
+	if (inPlace) { workspace.row.resize(size_t(width)); }
+
+	for (coord_int y = beginY; y < endY; ++y) {
+		const PixelT* inLine = &in.getPixelUnsafe(view.offset() + Coord{ 0, y });
+		PixelT* outLine = &out.getPixelUnsafe(Coord{ 0, y });
+
+		if (inPlace) {
+			boxFilterRow(inLine, workspace.row.data(), width, windowSize);
+			std::copy(workspace.row.begin(), workspace.row.end(), outLine);
+		}
+		else {
+			boxFilterRow(inLine, outLine, width, windowSize);
+		}
+	}
+}
+
+// Transpose floats [begin, end) of FloatVec::lanes() rows into block, where they are stored as one
+// vector of lanes() floats per float position, one from each row.
+inline void transposeToBlock(const float* const* rows, size_t begin, size_t end, float* block) {
+	using simd::FloatVec;
+	constexpr auto lanes = FloatVec::lanes();
+	const auto tiledEnd = begin + (end - begin) / lanes * lanes;
+
+	for (size_t j = begin; j < tiledEnd; j += lanes) {
+		FloatVec tile[lanes];
+		for (size_t i = 0; i < lanes; ++i) { tile[i] = FloatVec::load(rows[i] + j); }
+		FloatVec::transpose(tile);
+		for (size_t i = 0; i < lanes; ++i) { tile[i].store(block + (j - begin + i) * lanes); }
+	}
+
+	for (size_t j = tiledEnd; j < end; ++j) {
+		for (size_t lane = 0; lane < lanes; ++lane) { block[(j - begin) * lanes + lane] = rows[lane][j]; }
+	}
+}
+
+// Inverse of transposeToBlock, transposing block back into floats [begin, end) of the rows.
+inline void transposeFromBlock(const float* block, size_t begin, size_t end, float* const* rows) {
+	using simd::FloatVec;
+	constexpr auto lanes = FloatVec::lanes();
+	const auto tiledEnd = begin + (end - begin) / lanes * lanes;
+
+	for (size_t j = begin; j < tiledEnd; j += lanes) {
+		FloatVec tile[lanes];
+		for (size_t i = 0; i < lanes; ++i) { tile[i] = FloatVec::load(block + (j - begin + i) * lanes); }
+		FloatVec::transpose(tile);
+		for (size_t i = 0; i < lanes; ++i) { tile[i].store(rows[i] + j); }
+	}
+
+	for (size_t j = tiledEnd; j < end; ++j) {
+		for (size_t lane = 0; lane < lanes; ++lane) { rows[lane][j] = block[(j - begin) * lanes + lane]; }
+	}
+}
+
+// Box filter over FloatVec::lanes() rows of n pixels at once, from in to out, which may alias, each
+// pixel being channels floats. The rows are transposed so that float j of every row forms one
+// vector, and the window then slides over vectors exactly as boxFilterLine slides over elements,
+// with each lane carrying an independent accumulator rather than the whole loop waiting on a single
+// one.
+// Positions are processed in chunks of lanes() pixels. Before each chunk, its pixels are transposed
+// into a ring that only needs to cover the window, and after it, complete chunks of means are
+// transposed back into the output rows, so working memory stays in cache however wide the rows are.
+// Every boxFilterResyncInterval() positions or so, the sums are recomputed from the window in the
+// ring. buffer is resized as needed.
+template <size_t channels>
+void boxFilterRowBlock(
+	const float* const* in, float* const* out, coord_int n, coord_int windowSize,
+	std::vector<float>& buffer
+) {
+	using simd::FloatVec;
+	constexpr auto lanes = FloatVec::lanes();
+	constexpr auto pixelSize = channels * lanes; // Floats per transposed pixel
+	const auto halfWindowSize = windowSize / 2;
+
+	// Ring holding at least the window and the chunk ahead of it, followed by a ring of two chunks
+	// of means. Both are a power of two pixels long, and chunks start at multiples of lanes(), so
+	// chunks are contiguous within them.
+	size_t ringPixels = lanes;
+	while (ringPixels < size_t(windowSize) + lanes) { ringPixels *= 2; }
+	const auto ringMask = ringPixels - 1;
+	const auto meansMask = 2 * lanes - 1;
+
+	buffer.resize((ringPixels + 2 * lanes) * pixelSize);
+	float* ring = buffer.data();
+	float* means = ring + ringPixels * pixelSize;
+
+	// Means of pixels before flushed have been written to the output rows.
+	size_t flushed = 0;
+
+	// Run slide(begin, end) over chunks of positions [begin, end), transposing pixels in before each
+	// chunk and complete chunks of means out after it.
+	auto run = [&](coord_int begin, coord_int end, auto slide) {
+		while (begin < end) {
+			const auto chunkEnd = std::min(end, (begin / coord_int(lanes) + 1) * coord_int(lanes));
+
+			if (begin < n && begin % coord_int(lanes) == 0) {
+				const auto pixelsEnd = std::min(size_t(begin) + lanes, size_t(n));
+				transposeToBlock(in, size_t(begin) * channels, pixelsEnd * channels,
+					ring + (size_t(begin) & ringMask) * pixelSize);
+			}
+
+			slide(begin, chunkEnd);
+
+			const auto meansEnd = size_t(std::max(coord_int(0), chunkEnd - halfWindowSize));
+			while (flushed < meansEnd && (flushed + lanes <= meansEnd || meansEnd == size_t(n))) {
+				const auto flushEnd = std::min(flushed + lanes, meansEnd);
+				transposeFromBlock(means + (flushed & meansMask) * pixelSize,
+					flushed * channels, flushEnd * channels, out);
+				flushed = flushEnd;
+			}
+
+			begin = chunkEnd;
+		}
+	};
+
+	// The slide functions work on local copies of the accumulators and buffer pointers, which would
+	// otherwise be reloaded from memory on every step, as they might alias the floats being stored.
+	std::array<FloatVec, channels> accum;
+	accum.fill(FloatVec::set(0.0f));
+	int weight = 0;
+
+	auto border = [&](coord_int begin, coord_int end) {
+		run(begin, end, [&](coord_int chunkBegin, coord_int chunkEnd) {
+			auto sum = accum;
+			const float* const ringBegin = ring;
+			float* const meansBegin = means;
+
+			for (coord_int o = chunkBegin; o < chunkEnd; ++o) {
+				const float* removed = ringBegin + (size_t(o - windowSize) & ringMask) * pixelSize;
+				const float* added = ringBegin + (size_t(o) & ringMask) * pixelSize;
+				float* mean = meansBegin + (size_t(o - halfWindowSize) & meansMask) * pixelSize;
+
+				for (size_t c = 0; c < channels; ++c) {
+					if (o >= windowSize) { sum[c] = sum[c] - FloatVec::load(removed + c * lanes); }
+					if (o < n) { sum[c] = sum[c] + FloatVec::load(added + c * lanes); }
+				}
+
+				weight += (o < windowSize) - (o >= n);
+
+				if (o >= halfWindowSize) {
+					const auto divisor = FloatVec::set(float(weight));
+					for (size_t c = 0; c < channels; ++c) { (sum[c] / divisor).store(mean + c * lanes); }
+				}
+			}
+
+			accum = sum;
+		});
+	};
+
+	// Resynchronised at the start of chunks, rounded up to a whole number of them.
+	const auto resyncInterval = coord_int(
+		(size_t(boxFilterResyncInterval(windowSize)) + lanes - 1) / lanes * lanes
+	);
+
+	// Multiplying by the reciprocal rather than dividing, as vector division is slow enough to be the
+	// bottleneck otherwise. Means may differ from boxFilterLine's in the last bit.
+	auto interior = [&](coord_int begin, coord_int end) {
+		const auto scale = FloatVec::set(1.0f / float(weight));
+
+		run(begin, end, [&](coord_int chunkBegin, coord_int chunkEnd) {
+			auto sum = accum;
+			const float* const ringBegin = ring;
+			float* const meansBegin = means;
+
+			// The window before chunkBegin is still in the ring, the chunk transposed in for
+			// chunkBegin having replaced pixels ringPixels behind it.
+			if (chunkBegin % resyncInterval == 0) {
+				sum.fill(FloatVec::set(0.0f));
+
+				for (coord_int p = chunkBegin - windowSize; p < chunkBegin; ++p) {
+					const float* pixel = ringBegin + (size_t(p) & ringMask) * pixelSize;
+					for (size_t c = 0; c < channels; ++c) {
+						sum[c] = sum[c] + FloatVec::load(pixel + c * lanes);
+					}
+				}
+			}
+
+			for (coord_int o = chunkBegin; o < chunkEnd; ++o) {
+				const float* removed = ringBegin + (size_t(o - windowSize) & ringMask) * pixelSize;
+				const float* added = ringBegin + (size_t(o) & ringMask) * pixelSize;
+				float* mean = meansBegin + (size_t(o - halfWindowSize) & meansMask) * pixelSize;
+
+				for (size_t c = 0; c < channels; ++c) {
+					sum[c] = sum[c] - FloatVec::load(removed + c * lanes);
+					sum[c] = sum[c] + FloatVec::load(added + c * lanes);
+					(sum[c] * scale).store(mean + c * lanes);
+				}
+			}
+
+			accum = sum;
+		});
+	};
+
+	forInteriorAndBorder(n + halfWindowSize, n, windowSize, 0, interior, border);
+}
+
+// Horizontal pass over an image whose pixels are one or more floats, e.g. float or Pixel, filtering
+// FloatVec::lanes() rows at a time. The last block of rows is padded by repeating its last row,
+// which is then written several times over with the same values. Lanes are filtered independently,
+// so results do not depend on how rows are grouped into blocks.
+template <typename PixelT>
+void boxFilterHorizontalPassVectorised(
+	const BaseImage<PixelT>& in, const ImageView& view, BaseImage<PixelT>& out, coord_int windowSize,
+	coord_int beginY, coord_int endY, BoxFilterWorkspace<PixelT>& workspace
+) {
+	constexpr auto channels = sizeof(PixelT) / sizeof(float);
+	constexpr auto lanes = simd::FloatVec::lanes();
+
+	static_assert(sizeof(PixelT) == channels * sizeof(float), "Pixels must be tightly packed floats.");
+
+	if (view.width() <= 0 || endY <= beginY) { return; }
+
+	for (auto first = size_t(beginY); first < size_t(endY); first += lanes) {
+		const float* inRows[lanes];
+		float* outRows[lanes];
+
+		for (size_t lane = 0; lane < lanes; ++lane) {
+			const auto y = coord_int(std::min(first + lane, size_t(endY) - 1));
+			const auto& inPixel = in.getPixelUnsafe(view.offset() + Coord{ 0, y });
+			inRows[lane] = reinterpret_cast<const float*>(&inPixel);
+			outRows[lane] = reinterpret_cast<float*>(&out.getPixelUnsafe(Coord{ 0, y }));
+		}
+
+		boxFilterRowBlock<channels>(inRows, outRows, view.width(), windowSize, workspace.block);
+	}
+}
+
+template <>
+inline void boxFilterHorizontalPass<float>(
+	const ImageGrey& in, const ImageView& view, ImageGrey& out, coord_int windowSize,
+	coord_int beginY, coord_int endY, BoxFilterWorkspace<float>& workspace
+) {
+	boxFilterHorizontalPassVectorised(in, view, out, windowSize, beginY, endY, workspace);
+}
+
+template <>
+inline void boxFilterHorizontalPass<Pixel>(
+	const ImageRgb& in, const ImageView& view, ImageRgb& out, coord_int windowSize,
+	coord_int beginY, coord_int endY, BoxFilterWorkspace<Pixel>& workspace
+) {
+	boxFilterHorizontalPassVectorised(in, view, out, windowSize, beginY, endY, workspace);
+}
+
+// Element-wise row operations of ColumnBoxFilter over n elements.
+template <typename T>
+struct ScalarColumnOps {
+	using Sum = typename BoxFilterSum<T>::type;
+
+	// Window moved down within the image: remove saved, add added, and save it in place of saved.
+	static void slide(Sum* accum, T* saved, const T* added, size_t n) {
+		for (size_t x = 0; x < n; ++x) {
+			accum[x] -= saved[x];
+			accum[x] += added[x];
+			saved[x] = added[x];
+		}
+	}
+
+	static void remove(Sum* accum, const T* saved, size_t n) {
+		for (size_t x = 0; x < n; ++x) { accum[x] -= saved[x]; }
+	}
+
+	static void add(Sum* accum, T* saved, const T* added, size_t n) {
+		for (size_t x = 0; x < n; ++x) {
+			accum[x] += added[x];
+			saved[x] = added[x];
+		}
+	}
+
+	static void mean(const Sum* accum, int weight, T* mean, size_t n) {
+		for (size_t x = 0; x < n; ++x) { mean[x] = accum[x] / float(weight); }
+	}
+
+	// Set accum to the sum of numRows consecutive rows.
+	static void total(Sum* accum, const T* rows, size_t numRows, size_t n) {
+		std::fill(accum, accum + n, Sum{});
+
+		for (size_t row = 0; row < numRows; ++row) {
+			for (size_t x = 0; x < n; ++x) { accum[x] += rows[row * n + x]; }
+		}
+	}
+};
+
+template <typename T>
+struct ColumnOps : ScalarColumnOps<T> {};
+
+// Same for integers in SIMD vectors of their 32-bit sums. Means are rounded to nearest, as in
+// boxFilterLineInteger.
+template <typename T>
+struct IntegerColumnOps {
+	using Uint32Vec = simd::Uint32Vec;
+	static constexpr size_t lanes = Uint32Vec::lanes();
+
+	// Rows are saved after updating the sums, which read the previously saved row.
+	static void slide(uint32_t* accum, T* saved, const T* added, size_t n) {
+		size_t x = 0;
+		for (; x + lanes <= n; x += lanes) {
+			(Uint32Vec::load(accum + x) - Uint32Vec::load(saved + x) + Uint32Vec::load(added + x))
+				.store(accum + x);
+		}
+		for (; x < n; ++x) { accum[x] = accum[x] - saved[x] + added[x]; }
+
+		std::copy(added, added + n, saved);
+	}
+
+	static void remove(uint32_t* accum, const T* saved, size_t n) {
+		size_t x = 0;
+		for (; x + lanes <= n; x += lanes) {
+			(Uint32Vec::load(accum + x) - Uint32Vec::load(saved + x)).store(accum + x);
+		}
+		ScalarColumnOps<T>::remove(accum + x, saved + x, n - x);
+	}
+
+	static void add(uint32_t* accum, T* saved, const T* added, size_t n) {
+		size_t x = 0;
+		for (; x + lanes <= n; x += lanes) {
+			(Uint32Vec::load(accum + x) + Uint32Vec::load(added + x)).store(accum + x);
+		}
+		for (; x < n; ++x) { accum[x] += added[x]; }
+
+		std::copy(added, added + n, saved);
+	}
+
+	static void mean(const uint32_t* accum, int weight, T* mean, size_t n) {
+		const IntegerMean toMean{ weight };
+		size_t x = 0;
+		for (; x + lanes <= n; x += lanes) { toMean(Uint32Vec::load(accum + x)).store(mean + x); }
+		for (; x < n; ++x) { mean[x] = T(toMean(accum[x])); }
+	}
+
+	// Integer sums are exact, so ColumnBoxFilter never needs to recompute them.
+	static void total(uint32_t* accum, const T* rows, size_t numRows, size_t n) {
+		ScalarColumnOps<T>::total(accum, rows, numRows, n);
+	}
+};
+
+template <>
+struct ColumnOps<uint8_t> : IntegerColumnOps<uint8_t> {};
+
+template <>
+struct ColumnOps<uint16_t> : IntegerColumnOps<uint16_t> {};
+
+// Same for floats in SIMD vectors, which compilers only do by themselves at higher optimisation
+// levels, as the rows might alias.
+template <>
+struct ColumnOps<float> {
+	using FloatVec = simd::FloatVec;
+	static constexpr size_t lanes = FloatVec::lanes();
+
+	static void slide(float* accum, float* saved, const float* added, size_t n) {
+		size_t x = 0;
+		for (; x + lanes <= n; x += lanes) {
+			const auto a = FloatVec::load(added + x);
+			((FloatVec::load(accum + x) - FloatVec::load(saved + x)) + a).store(accum + x);
+			a.store(saved + x);
+		}
+		ScalarColumnOps<float>::slide(accum + x, saved + x, added + x, n - x);
+	}
+
+	static void remove(float* accum, const float* saved, size_t n) {
+		size_t x = 0;
+		for (; x + lanes <= n; x += lanes) {
+			(FloatVec::load(accum + x) - FloatVec::load(saved + x)).store(accum + x);
+		}
+		ScalarColumnOps<float>::remove(accum + x, saved + x, n - x);
+	}
+
+	static void add(float* accum, float* saved, const float* added, size_t n) {
+		size_t x = 0;
+		for (; x + lanes <= n; x += lanes) {
+			const auto a = FloatVec::load(added + x);
+			(FloatVec::load(accum + x) + a).store(accum + x);
+			a.store(saved + x);
+		}
+		ScalarColumnOps<float>::add(accum + x, saved + x, added + x, n - x);
+	}
+
+	// Multiplying by the reciprocal rather than dividing, as in boxFilterRowBlock.
+	static void mean(const float* accum, int weight, float* mean, size_t n) {
+		const float scale = 1.0f / float(weight);
+		const auto scaleVec = FloatVec::set(scale);
+		size_t x = 0;
+		for (; x + lanes <= n; x += lanes) { (FloatVec::load(accum + x) * scaleVec).store(mean + x); }
+		for (; x < n; ++x) { mean[x] = accum[x] * scale; }
+	}
+
+	static void total(float* accum, const float* rows, size_t numRows, size_t n) {
+		size_t x = 0;
+		for (; x + lanes <= n; x += lanes) {
+			auto sum = FloatVec::set(0.0f);
+			for (size_t row = 0; row < numRows; ++row) { sum = sum + FloatVec::load(rows + row * n + x); }
+			sum.store(accum + x);
+		}
+		ScalarColumnOps<float>::total(accum + x, rows + x, numRows, n - x);
+	}
+};
+
+// Vertical box filter over rows of width pixels fed in order from top to bottom. Rather than
+// walking down each column in turn, a whole row of column accumulators slides down the image, so
+// memory is accessed row by row in order, and the operations on columns are independent of each
+// other and vectorise. Per column, the arithmetic is the same as boxFilterLine's, except that means
+// of floats are found by multiplying by the reciprocal of the weight. Rows are saved in a ring of
+// windowSize rows until they leave the window, so callers may overwrite them in the meantime.
+// Floating-point sums are recomputed from the ring every boxFilterResyncInterval() rows.
+template <typename PixelT>
+class ColumnBoxFilter {
+public:
+	using Element = typename BoxFilterElement<PixelT>::type;
+	using Sum = typename BoxFilterSum<Element>::type;
+	using Ops = ColumnOps<Element>;
+
+	static_assert(sizeof(PixelT) % sizeof(Element) == 0, "Pixels must be made of whole elements.");
+
+	ColumnBoxFilter() = default;
+
+	ColumnBoxFilter(size_t width, coord_int height, coord_int windowSize) {
+		reset(width, height, windowSize);
+	}
+
+	/** Start over at the top of an image of the given size, reusing memory already allocated. */
+	void reset(size_t width, coord_int height, coord_int windowSize) {
+		m_size = width * (sizeof(PixelT) / sizeof(Element));
+		m_height = height;
+		m_windowSize = windowSize;
+		m_weight = 0;
+		m_resyncInterval = std::is_integral<Sum>::value ? 0 : boxFilterResyncInterval(windowSize);
+
+		m_accum.assign(m_size, Sum{});
+		m_ring.resize(m_size * size_t(std::min(windowSize, height)));
+	}
+
+	/** Slide window to position o, for o from 0 up to height + windowSize / 2 in turn. Adds row o,
+	 * which must be given while o < height, and removes row o - windowSize. Then, if meanRow is
+	 * given (from o = windowSize / 2 on), sets it to the mean of output row o - windowSize / 2.
+	 * meanRow may alias the row added.
+	 */
+	void step(coord_int o, const PixelT* addedRow, PixelT* meanRow) {
+		const auto added = reinterpret_cast<const Element*>(addedRow);
+
+		// Row o is kept in ring slot o % windowSize, which holds row o - windowSize until then.
+		Element* saved = &m_ring[size_t(o % m_windowSize) * m_size];
+
+		if (o >= m_windowSize && o < m_height) {
+			Ops::slide(m_accum.data(), saved, added, m_size); // Weight is windowSize
+
+			// The ring now holds the whole window.
+			if (m_resyncInterval > 0 && o % m_resyncInterval == 0) {
+				Ops::total(m_accum.data(), m_ring.data(), size_t(m_windowSize), m_size);
 			}
 		}
-		
-		// Copy row / column values to output image.
-		for (coord_int o = 0; o < innerSize; ++o) {
-			const auto c = vertical ? Coord{i, o} : Coord{o, i};
-			image[c] = rowOrColumn[size_t(o)];
+		else {
+			if (o < m_windowSize) { ++m_weight; }
+			else { Ops::remove(m_accum.data(), saved, m_size); }
+
+			if (o < m_height) { Ops::add(m_accum.data(), saved, added, m_size); }
+			else { --m_weight; }
+		}
+
+		if (meanRow) {
+			Ops::mean(m_accum.data(), m_weight, reinterpret_cast<Element*>(meanRow), m_size);
 		}
 	}
+
+private:
+	size_t m_size = 0; // Elements per row
+	coord_int m_height = 0, m_windowSize = 1;
+	coord_int m_resyncInterval = 0; // Never if 0
+	int m_weight = 0;
+	std::vector<Sum> m_accum;
+	std::vector<Element> m_ring;
+};
+
+// Vertical pass of box filter over columns [beginX, endX) of view, a region of in, into the same
+// columns of out, which is the size of view. Rows of in above and below view are read as far as
+// windows reach. out may be in itself if view covers all of it, output row o - windowSize / 2 being
+// written after row o has been read at each step.
+template <typename PixelT>
+void boxFilterVerticalPass(
+	const BaseImage<PixelT>& in, const ImageView& view, BaseImage<PixelT>& out, coord_int windowSize,
+	coord_int beginX, coord_int endX, ColumnBoxFilter<PixelT>& columns
+) {
+	const auto halfWindowSize = windowSize / 2;
+
+	if (endX <= beginX || view.height() <= 0) { return; }
+
+	// Column of rows [firstRow, endRow) of in, whose position o gives the mean of row
+	// firstRow + o - windowSize / 2, and so of row o - meansBegin of view.
+	const auto firstRow = std::max(coord_int(0), view.offset().y - (windowSize - 1) / 2);
+	const auto endRow = std::min(in.height(), view.offset().y + view.height() + halfWindowSize);
+	const auto meansBegin = view.offset().y - firstRow + halfWindowSize;
+	const auto x = view.offset().x + beginX;
+
+	columns.reset(size_t(endX - beginX), endRow - firstRow, windowSize);
+
+	for (coord_int o = 0; o < meansBegin + view.height(); ++o) {
+		columns.step(o,
+			(firstRow + o < endRow) ? &in.getPixelUnsafe(Coord{ x, firstRow + o }) : nullptr,
+			(o >= meansBegin) ? &out.getPixelUnsafe(Coord{ beginX, o - meansBegin }) : nullptr
+		);
+	}
+}
+
+// Working memory of one of the tasks a box filter pass is split into.
+template <typename PixelT>
+struct BoxFilterWorkspace {
+	std::vector<PixelT> row;         // Row being filtered in place by the generic horizontal pass
+	std::vector<float> block;        // Transposed pixels of the vectorised horizontal pass
+	ColumnBoxFilter<PixelT> columns; // Vertical pass
+};
+
+template <typename PixelT>
+struct BoxFilterBuffers {
+	std::vector<BoxFilterWorkspace<PixelT>> tasks;
+
+	// Rows of a region and the pixels around it, filtered horizontally. Filtering whole images
+	// uses the output image instead.
+	BaseImage<PixelT> rows{ 0, 0 };
+};
+
+// Bilinear interpolation of pixel i of a row or column from the samples of a subsampled one, taken
+// at the centres of their blocks: lower + weight * (upper - lower), clamped at the borders.
+struct Interpolation {
+	coord_int lower, upper;
+	float weight;
+};
+
+struct GuidedFilterBuffers {
+	// Means of a channel of the input and of its products with the guide, then the coefficients
+	std::vector<ImageGrey> planes;
+	BoxFilterBuffers<float> boxFilter;
+
+	// Fast guided filter only: the input downsampled, the interpolations of the columns and rows of
+	// the guide from those of the coefficients, and a row of upsampled coefficients per task.
+	ImageGrey downsampledGrey{ 0, 0 };
+	ImageRgb downsampledRgb{ 0, 0 };
+	std::vector<Interpolation> columns, rows;
+	std::vector<std::vector<float>> coefficientRows;
+};
+
+// Rows per item of work of the horizontal pass, a whole number of blocks of the vectorised pass.
+constexpr coord_int boxFilterRowsPerItem = coord_int(4 * simd::FloatVec::lanes());
+
+// Width in pixels of the strips of columns the vertical pass is split into. Strips are narrow enough
+// for the ring of rows of ColumnBoxFilter to stay in a 256 KiB L2 cache, but at most 512 elements
+// wide, so that images a few thousand pixels wide still split into enough strips to share between
+// threads. Strips are a multiple of 64 pixels wide, keeping SIMD vectors in the same columns as
+// when filtering whole rows.
+template <typename PixelT>
+coord_int boxFilterStripWidth(coord_int windowSize) {
+	using Element = typename ColumnBoxFilter<PixelT>::Element;
+	using Sum = typename ColumnBoxFilter<PixelT>::Sum;
+
+	const auto columnSize = size_t(windowSize) * sizeof(Element) + sizeof(Sum);
+	const auto elements = std::min(size_t(512), size_t(256) * 1024 / columnSize);
+	const auto pixels = elements / (sizeof(PixelT) / sizeof(Element)) / 64 * 64;
+
+	return coord_int(std::max(size_t(64), pixels));
+}
+
+// Split items [0, count) of work into contiguous ranges, one per thread of the shared thread pool at
+// most, and call fn(workspace, begin, end) for each range in parallel, with a workspace of its own
+// from workspaces, which is grown as needed. Callers make the work of each item independent of
+// which range it falls in, so that results do not depend on the number of threads.
+template <typename Workspace, typename Fn>
+void forEachRangeParallel(size_t count, std::vector<Workspace>& workspaces, Fn fn) {
+	if (count == 0) { return; }
+
+	auto& pool = getThreadPool();
+	const auto numRanges = std::min(pool.numThreads(), count);
+
+	if (workspaces.size() < numRanges) { workspaces.resize(numRanges); }
+
+	const auto run = [&](size_t range) {
+		fn(workspaces[range], count * range / numRanges, count * (range + 1) / numRanges);
+	};
+
+	// Passed by reference, which std::function holds without allocating, unlike the lambda itself.
+	pool.parallelFor(numRanges, std::cref(run));
+}
+
+// Number of blocks of size elements covering total elements.
+inline size_t numBlocks(coord_int total, coord_int size) {
+	return size_t((total + size - 1) / size);
+}
+
+// Range [begin, end) of elements of the given block of size elements, the last block being cut short
+// at total elements.
+inline std::pair<coord_int, coord_int> blockRange(size_t block, coord_int size, coord_int total) {
+	const auto begin = coord_int(block) * size;
+	return { begin, std::min(begin + size, total) };
+}
+
+template <typename PixelT>
+void boxFilter(
+	const BaseImage<PixelT>& image, const ImageView& region, size_t r, BaseImage<PixelT>& out,
+	BoxFilterBuffers<PixelT>& buffers
+) {
+	const auto width = region.width(), height = region.height();
+	const auto windowSize = std::max(coord_int(1), coord_int(r));
+
+	assert(region.offset().x + width <= image.width());
+	assert(region.offset().y + height <= image.height());
+
+	if (out.width() != width || out.height() != height) { out = BaseImage<PixelT>{ width, height }; }
+
+	if (width <= 0 || height <= 0) { return; }
+
+	// Region and the pixels around it that its windows reach, which are filtered horizontally into
+	// rows, split into blocks of rows. The vertical pass then filters the region's columns of rows
+	// into out, split into strips of columns. For the whole image, rows is out, filtered in place.
+	const auto before = (windowSize - 1) / 2, after = windowSize / 2;
+	const auto reachBegin = Coord{
+		std::max(coord_int(0), region.offset().x - before),
+		std::max(coord_int(0), region.offset().y - before)
+	};
+	const auto reachEnd = Coord{
+		std::min(image.width(), region.offset().x + width + after),
+		std::min(image.height(), region.offset().y + height + after)
+	};
+	const auto reach = ImageView{ reachBegin, reachEnd.x - reachBegin.x, reachEnd.y - reachBegin.y };
+
+	auto& rows = (reach == region) ? out : buffers.rows;
+
+	if (rows.width() != reach.width() || rows.height() != reach.height()) {
+		rows = BaseImage<PixelT>{ reach.width(), reach.height() };
+	}
+
+	forEachRangeParallel(numBlocks(reach.height(), boxFilterRowsPerItem), buffers.tasks,
+		[&](BoxFilterWorkspace<PixelT>& workspace, size_t begin, size_t end) {
+			for (auto item = begin; item < end; ++item) {
+				const auto block = blockRange(item, boxFilterRowsPerItem, reach.height());
+				boxFilterHorizontalPass(
+					image, reach, rows, windowSize, block.first, block.second, workspace
+				);
+			}
+		}
+	);
+
+	const auto view = ImageView{ region.offset() - reach.offset(), width, height };
+	const auto stripWidth = boxFilterStripWidth<PixelT>(windowSize);
+
+	forEachRangeParallel(numBlocks(width, stripWidth), buffers.tasks,
+		[&](BoxFilterWorkspace<PixelT>& workspace, size_t begin, size_t end) {
+			for (auto item = begin; item < end; ++item) {
+				const auto strip = blockRange(item, stripWidth, width);
+				boxFilterVerticalPass(
+					rows, view, out, windowSize, strip.first, strip.second, workspace.columns
+				);
+			}
+		}
+	);
+}
+
+template <typename PixelT>
+void boxFilter(
+	const BaseImage<PixelT>& image, size_t r, BaseImage<PixelT>& out, BoxFilterBuffers<PixelT>& buffers
+) {
+	boxFilter(image, image.getView(), r, out, buffers);
+}
+
+template <typename PixelT>
+BaseImage<PixelT> boxFilter(const BaseImage<PixelT>& image, const ImageView& region, size_t r) {
+	BaseImage<PixelT> out{ region.width(), region.height() };
+	BoxFilterBuffers<PixelT> buffers;
+
+	boxFilter(image, region, r, out, buffers);
+
+	return out;
 }
 
 template <typename PixelT>
 BaseImage<PixelT> boxFilter(const BaseImage<PixelT>& image, size_t r) {
-	BaseImage<PixelT> out{ image  };
+	BaseImage<PixelT> out{ image.width(), image.height() };
+	BoxFilterBuffers<PixelT> buffers;
+
+	boxFilter(image, r, out, buffers);
+
+	return out;
+}
+
+template <typename PixelT>
+BaseImage<PixelT> boxFilter(BaseImage<PixelT>&& image, size_t r) {
+	BoxFilterBuffers<PixelT> buffers;
+
+	boxFilter(image, r, image, buffers);
+
+	return std::move(image);
+}
+
+// Box filter over planes of floats, all of the size of out[0], into out, with working memory in
+// buffers. getRow(plane, y, buffer) must return a pointer to row y of the plane, either its own
+// storage or buffer filled with the row, and may be called concurrently for different rows.
+// Source rows are fetched straight into the output rows and filtered horizontally there, blocks of
+// rows of each plane in parallel, and then all planes are filtered vertically in place, strips of
+// columns of each plane in parallel, as in boxFilter. Results equal those of boxFilter on each plane.
+template <typename GetRow>
+void boxFilterPlanes(
+	coord_int windowSize, GetRow getRow, std::vector<ImageGrey>& out, BoxFilterBuffers<float>& buffers
+) {
+	if (out.empty() || out[0].width() <= 0 || out[0].height() <= 0) { return; }
+
+	constexpr auto lanes = simd::FloatVec::lanes();
+	const auto width = out[0].width(), height = out[0].height();
+	const auto numPlanes = out.size();
+
+	auto& workspaces = buffers.tasks;
+
+	const auto numRowItems = numBlocks(height, boxFilterRowsPerItem);
+
+	forEachRangeParallel(numPlanes * numRowItems, workspaces,
+		[&](BoxFilterWorkspace<float>& workspace, size_t begin, size_t end) {
+			for (auto item = begin; item < end; ++item) {
+				const auto plane = item / numRowItems;
+				const auto rows = blockRange(item % numRowItems, boxFilterRowsPerItem, height);
 
-	const auto radius = coord_int(r);
+				// The last block of rows is padded by repeating the last row, which is fetched once.
+				for (auto first = rows.first; first < rows.second; first += coord_int(lanes)) {
+					const float* inRows[lanes];
+					float* outRows[lanes];
 
-	boxFilterPass<false>(out, radius); // horizontal pass
-	boxFilterPass<true>(out, radius);  // vertical pass
+					for (size_t lane = 0; lane < lanes; ++lane) {
+						const auto y = std::min(first + coord_int(lane), rows.second - 1);
+						outRows[lane] = &out[plane].getPixelUnsafe(Coord{ 0, y });
+						inRows[lane] = (lane > 0 && outRows[lane] == outRows[lane - 1])
+							? inRows[lane - 1] : getRow(plane, y, outRows[lane]);
+					}
+
+					boxFilterRowBlock<1>(inRows, outRows, width, windowSize, workspace.block);
+				}
+			}
+		}
+	);
+
+	const auto stripWidth = boxFilterStripWidth<float>(windowSize);
+	const auto numStrips = numBlocks(width, stripWidth);
+
+	forEachRangeParallel(numPlanes * numStrips, workspaces,
+		[&](BoxFilterWorkspace<float>& workspace, size_t begin, size_t end) {
+			for (auto item = begin; item < end; ++item) {
+				const auto plane = item / numStrips;
+				const auto columns = blockRange(item % numStrips, stripWidth, width);
+
+				boxFilterVerticalPass(out[plane], out[plane].getView(), out[plane], windowSize,
+					columns.first, columns.second, workspace.columns);
+			}
+		}
+	);
+}
+
+// Van Herk / Gil-Werman erosion of one line of n elements. The window for position i starts at
+// max(0, i - windowSize / 2) and spans windowSize elements, elements past the end of the line being
+// clamped to the last one. The window minimum is found from a prefix minimum and a suffix minimum
+// within blocks of windowSize elements, three comparisons per element whatever the window size.
+// prefix and suffix must have room for n + windowSize - 1 elements. in and out may alias.
+template <typename PixelT>
+void minFilterLine(
+	const PixelT* in, PixelT* out, coord_int n, coord_int windowSize, PixelT* prefix, PixelT* suffix
+) {
+	const auto halfWindowSize = windowSize / 2;
+	const auto extendedSize = n + windowSize - 1;
+
+	// Elements past the end of the line are clamped to the last one.
+	auto prefixStep = [&](coord_int i, PixelT element) {
+		prefix[i] = (i % windowSize == 0) ? element : std::min(prefix[i - 1], element);
+	};
+
+	forInteriorAndBorder(extendedSize, n, 0, 0,
+		[&](coord_int begin, coord_int end) {
+			for (coord_int i = begin; i < end; ++i) { prefixStep(i, in[i]); }
+		},
+		[&](coord_int begin, coord_int end) {
+			for (coord_int i = begin; i < end; ++i) { prefixStep(i, in[n - 1]); }
+		}
+	);
+
+	// Past the end of the line, suffix minima are just the last element. Iterating backwards, so
+	// handle that border before the interior.
+	std::fill(suffix + n, suffix + extendedSize, in[n - 1]);
+
+	for (coord_int i = n - 1; i >= 0; --i) {
+		const bool blockEnd = (i % windowSize == windowSize - 1) || (i == n - 1);
+		suffix[i] = blockEnd ? in[i] : std::min(suffix[i + 1], in[i]);
+	}
+
+	// Windows overlapping the start of the line are shifted inwards to start at 0.
+	forInteriorAndBorder(n, extendedSize, halfWindowSize, 0,
+		[&](coord_int begin, coord_int end) {
+			for (coord_int i = begin; i < end; ++i) {
+				const auto start = i - halfWindowSize;
+				out[i] = std::min(suffix[start], prefix[start + windowSize - 1]);
+			}
+		},
+		[&](coord_int begin, coord_int end) {
+			for (coord_int i = begin; i < end; ++i) {
+				out[i] = std::min(suffix[0], prefix[windowSize - 1]);
+			}
+		}
+	);
+}
+
+// Streaming min filter producing rows [beginY, endY) of the output; see minFilterRows.
+// Rows are eroded horizontally as they come in and kept in a ring of windowSize rows, which is
+// eroded vertically block-wise as in minFilterLine: when a block of windowSize rows is complete, the
+// ring is turned into suffix minima, while a running prefix minimum is kept for the next block.
+// Each row of the next block replaces a suffix row that is no longer needed, so only a few rows more
+// than windowSize are held in memory regardless of image height.
+template <typename PixelT, typename GetRow, typename PutRow>
+void minFilterBand(
+	coord_int width, coord_int height, coord_int windowSize, coord_int beginY, coord_int endY,
+	GetRow& getRow, PutRow& putRow
+) {
+	const auto halfWindowSize = windowSize / 2;
+	const auto rowSize = size_t(width);
+
+	std::vector<PixelT> ring, prefix, line, out, linePrefix, lineSuffix;
+	ring.resize(size_t(windowSize) * rowSize);
+	prefix.resize(rowSize);
+	line.resize(rowSize);
+	out.resize(rowSize);
+	linePrefix.resize(size_t(width + windowSize - 1));
+	lineSuffix.resize(size_t(width + windowSize - 1));
+
+	auto ringRow = [&](coord_int slot) { return &ring[size_t(slot) * rowSize]; };
+
+	// Source rows past the bottom border are clamped to the last row.
+	const auto firstWindowStart = std::max(0, beginY - halfWindowSize);
+	const auto lastWindowStart = std::max(0, endY - 1 - halfWindowSize);
+
+	for (coord_int j = firstWindowStart; j < lastWindowStart + windowSize; ++j) {
+		const auto slot = (j - firstWindowStart) % windowSize;
+		PixelT* row = ringRow(slot);
+
+		const PixelT* source = getRow(std::min(j, height - 1), line.data());
+		minFilterLine(source, row, width, windowSize, linePrefix.data(), lineSuffix.data());
+
+		for (size_t x = 0; x < rowSize; ++x) {
+			prefix[x] = (slot == 0) ? row[x] : std::min(prefix[x], row[x]);
+		}
+
+		// Block complete, turn it into suffix minima.
+		if (slot == windowSize - 1) {
+			for (coord_int s = windowSize - 2; s >= 0; --s) {
+				PixelT* current = ringRow(s);
+				const PixelT* next = ringRow(s + 1);
+				for (size_t x = 0; x < rowSize; ++x) { current[x] = std::min(current[x], next[x]); }
+			}
+		}
+
+		if (j < firstWindowStart + windowSize - 1) { continue; }
+
+		// Window covers rows [windowStart, j], that is the suffix of the previous block from
+		// windowStart and the prefix of the current block up to j.
+		const auto windowStart = j - windowSize + 1;
+		const PixelT* result = prefix.data();
+
+		if (slot != windowSize - 1) {
+			const PixelT* suffix = ringRow(slot + 1);
+			for (size_t x = 0; x < rowSize; ++x) { out[x] = std::min(suffix[x], prefix[x]); }
+			result = out.data();
+		}
+
+		// Windows overlapping the top border are shifted inwards, so all of the first rows share
+		// the window starting at row 0.
+		const auto firstY = std::max(beginY, (windowStart == 0) ? 0 : windowStart + halfWindowSize);
+		const auto lastY = std::min(windowStart + halfWindowSize, endY - 1);
+
+		for (coord_int y = firstY; y <= lastY; ++y) { putRow(y, result); }
+	}
+}
+
+// Streaming min filter over rows supplied on demand, for windowSize >= 1, producing rows
+// [beginY, endY) of the filtered image. getRow(y, buffer) must return a pointer to row y of the
+// source image, either its own storage or buffer filled with the row. putRow(y, row) receives row y
+// of the filtered image.
+// The rows are split into horizontal bands filtered in parallel, so getRow and putRow may be called
+// concurrently for different rows. Each band reads a halo of windowSize / 2 rows from its neighbours,
+// or from the rows around [beginY, endY).
+template <typename PixelT, typename GetRow, typename PutRow>
+void minFilterRows(
+	coord_int width, coord_int height, coord_int windowSize, coord_int beginY, coord_int endY,
+	GetRow getRow, PutRow putRow
+) {
+	if (width <= 0 || endY <= beginY) { return; }
+
+	// Keep bands tall enough that re-reading halos stays cheap.
+	auto& pool = getThreadPool();
+	const auto numRows = endY - beginY;
+	const auto maxBands = std::max(coord_int(1), numRows / (2 * windowSize));
+	const auto numBands = std::min(coord_int(pool.numThreads()), maxBands);
+
+	pool.parallelFor(size_t(numBands), [&](size_t band) {
+		const auto bandBegin = beginY + coord_int(int64_t(numRows) * coord_int(band) / numBands);
+		const auto bandEnd = beginY + coord_int(int64_t(numRows) * coord_int(band + 1) / numBands);
+		minFilterBand<PixelT>(width, height, windowSize, bandBegin, bandEnd, getRow, putRow);
+	});
+}
+
+// Same for all rows of the image.
+template <typename PixelT, typename GetRow, typename PutRow>
+void minFilterRows(
+	coord_int width, coord_int height, coord_int windowSize, GetRow getRow, PutRow putRow
+) {
+	minFilterRows<PixelT>(width, height, windowSize, 0, height, getRow, putRow);
+}
+
+template <typename PixelT>
+BaseImage<PixelT> minFilter(
+	const BaseImage<PixelT>& image, const ImageView& region, size_t windowSize
+) {
+	const auto width = region.width(), height = region.height();
+	const auto size = std::max(coord_int(1), coord_int(windowSize));
+
+	assert(region.offset().x + width <= image.width());
+	assert(region.offset().y + height <= image.height());
+
+	BaseImage<PixelT> out{ width, height };
+
+	if (width <= 0 || height <= 0) { return out; }
+
+	// Columns that windows of the region's pixels reach, which start up to windowSize / 2 before
+	// them, or at column 0 and so up to windowSize - 1 after them. Only rows of the image are
+	// clamped, as windows end within them.
+	const auto beginX = std::max(coord_int(0), region.offset().x - size / 2);
+	const auto endX = std::min(image.width(), region.offset().x + width + size - 1);
+	const auto skip = region.offset().x - beginX;
+
+	minFilterRows<PixelT>(
+		endX - beginX, image.height(), size, region.offset().y, region.offset().y + height,
+		[&](coord_int y, PixelT*) { return &image.getPixelUnsafe(Coord{ beginX, y }); },
+		[&](coord_int y, const PixelT* row) {
+			std::copy(row + skip, row + skip + width,
+				&out.getPixelUnsafe(Coord{ 0, y - region.offset().y }));
+		}
+	);
 
 	return out;
 }
 
+template <typename PixelT>
+BaseImage<PixelT> minFilter(const BaseImage<PixelT>& image, size_t windowSize) {
+	return minFilter(image, image.getView(), windowSize);
+}
+
 }} // namespace ImgProc::filters
 
@@ -0,0 +1,125 @@
+#include "guided_filter_cache.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace ImgProc { namespace filters {
+
+std::shared_ptr<const GuidedFilterValues> GuidedFilterCache::get(
+	const ImageRgb& guide, size_t r, float eps, size_t subsample
+) {
+	subsample = std::max(size_t(1), subsample);
+
+	const Entry key{ hashPixels(guide), guide.width(), guide.height(), r, eps, subsample, nullptr };
+	const auto matches = [&key](const Entry& e) {
+		return e.hash == key.hash && e.width == key.width && e.height == key.height
+			&& e.r == key.r && e.eps == key.eps && e.subsample == key.subsample;
+	};
+
+	{
+		std::lock_guard<std::mutex> lock{ m_mutex };
+
+		const auto it = std::find_if(m_entries.begin(), m_entries.end(), matches);
+
+		if (it != m_entries.end()) {
+			m_entries.splice(m_entries.begin(), m_entries, it);
+			++m_hits;
+			return it->values;
+		}
+
+		++m_misses;
+	}
+
+	// Computed without holding the lock, so that lookups of other values are not held up. Threads
+	// missing the same values at once each compute them, and the first to finish caches its own.
+	auto values = std::make_shared<const GuidedFilterValues>(guide, r, eps, subsample);
+
+	std::lock_guard<std::mutex> lock{ m_mutex };
+
+	if (m_capacity == 0) { return values; }
+
+	const auto it = std::find_if(m_entries.begin(), m_entries.end(), matches);
+
+	if (it != m_entries.end()) {
+		m_entries.splice(m_entries.begin(), m_entries, it);
+		return it->values;
+	}
+
+	m_entries.push_front(key);
+	m_entries.front().values = values;
+
+	if (m_entries.size() > m_capacity) { m_entries.pop_back(); }
+
+	return values;
+}
+
+size_t GuidedFilterCache::size() const {
+	std::lock_guard<std::mutex> lock{ m_mutex };
+	return m_entries.size();
+}
+
+size_t GuidedFilterCache::hits() const {
+	std::lock_guard<std::mutex> lock{ m_mutex };
+	return m_hits;
+}
+
+size_t GuidedFilterCache::misses() const {
+	std::lock_guard<std::mutex> lock{ m_mutex };
+	return m_misses;
+}
+
+void GuidedFilterCache::clear() {
+	std::lock_guard<std::mutex> lock{ m_mutex };
+	m_entries.clear();
+}
+
+static uint64_t rotateLeft(uint64_t x, unsigned n) { return (x << n) | (x >> (64 - n)); }
+
+// Final mix of splitmix64, spreading every input bit over the whole hash.
+static uint64_t finalise(uint64_t x) {
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9u;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebu;
+	return x ^ (x >> 31);
+}
+
+uint64_t hashPixels(const ImageRgb& image) {
+	constexpr uint64_t k1 = 0x9e3779b97f4a7c15u, k2 = 0xc2b2ae3d27d4eb4fu;
+
+	const auto* bytes = reinterpret_cast<const unsigned char*>(image.data().data());
+	const size_t size = image.data().size() * sizeof(Pixel);
+
+	// Four independent lanes over 32 byte blocks, so that their multiplies overlap, then the
+	// remaining 8 byte words into the first lane and the last bytes zero padded into the second.
+	uint64_t lanes[4] = { k1, k2, k1 ^ k2, k1 + k2 };
+	const auto mix = [](uint64_t lane, uint64_t word) {
+		return rotateLeft(lane ^ (word * k2), 31) * k1;
+	};
+
+	size_t i = 0;
+
+	for (; i + 32 <= size; i += 32) {
+		uint64_t words[4];
+		std::memcpy(words, bytes + i, sizeof(words));
+
+		for (size_t l = 0; l < 4; ++l) { lanes[l] = mix(lanes[l], words[l]); }
+	}
+
+	for (; i + 8 <= size; i += 8) {
+		uint64_t word;
+		std::memcpy(&word, bytes + i, sizeof(word));
+		lanes[0] = mix(lanes[0], word);
+	}
+
+	if (i < size) {
+		uint64_t word = 0;
+		std::memcpy(&word, bytes + i, size - i);
+		lanes[1] = mix(lanes[1], word);
+	}
+
+	uint64_t h = uint64_t(size);
+	for (size_t l = 0; l < 4; ++l) { h = finalise(h ^ lanes[l]); }
+
+	return h;
+}
+
+}} // namespace ImgProc::filters
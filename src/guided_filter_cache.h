@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+
+#include "filters.h"
+
+namespace ImgProc { namespace filters {
+
+/** Least recently used cache of GuidedFilterValues, for filtering many images against guides
+ * that repeat, e.g. the frames of a fixed camera. Values are keyed by a 64-bit hash of the guide's
+ * pixels together with its size and the filter parameters, so a guide is recognised by its content
+ * whatever image object holds it, at the cost of one pass over it per lookup, small next to
+ * computing the values. Two guides of the same size whose hashes collide would share values, with
+ * odds of about 2^-64 per pair. Safe to use from several threads at once.
+ */
+class GuidedFilterCache {
+public:
+	/** Cache holding values for up to capacity guides and parameter sets. With capacity 0, values
+	 * are computed on every lookup and not kept.
+	 */
+	explicit GuidedFilterCache(size_t capacity) : m_capacity(capacity) {}
+
+	/** Get values of guided filter with guide, radius r and eps, subsampled as guidedFilter is,
+	 * computing them unless cached. The least recently used values are dropped once more than
+	 * capacity are held. Values returned stay valid after they are dropped from the cache, for as
+	 * long as they are held.
+	 */
+	std::shared_ptr<const GuidedFilterValues> get(
+		const ImageRgb& guide, size_t r, float eps, size_t subsample = 1
+	);
+
+	/** Get number of values held. */
+	size_t size() const;
+
+	/** Get maximum number of values held. */
+	size_t capacity() const { return m_capacity; }
+
+	/** Get number of lookups that found values already cached. */
+	size_t hits() const;
+
+	/** Get number of lookups that computed values. */
+	size_t misses() const;
+
+	/** Drop all values held, keeping hit and miss counts. */
+	void clear();
+
+private:
+	struct Entry {
+		uint64_t hash;
+		coord_int width, height;
+		size_t r;
+		float eps;
+		size_t subsample;
+		std::shared_ptr<const GuidedFilterValues> values;
+	};
+
+	const size_t m_capacity;
+
+	// Most recently used first
+	std::list<Entry> m_entries;
+	size_t m_hits = 0, m_misses = 0;
+	mutable std::mutex m_mutex;
+};
+
+/** 64-bit hash of the pixels of image, reading its memory in one pass. Images whose pixels differ
+ * in any bit hash differently, up to collisions.
+ */
+uint64_t hashPixels(const ImageRgb& image);
+
+}} // namespace ImgProc::filters
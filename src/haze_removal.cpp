@@ -3,40 +3,134 @@
 #include <algorithm>
 #include <cmath>
 #include <limits>
+#include <numeric>
 #include <vector>
 
 #include "filters.h"
+#include "simd.h"
 
 namespace ImgProc { namespace filters {
 
-ImageGrey getDepthFromHazyImage(const ImageRgb& in, size_t kernelSize) {
+// Depth in [0, 1] converted to the type it is min-filtered as; fixed point for integer types.
+template <typename T>
+static T quantiseDepth(float depth) {
+	return T(depth * float(std::numeric_limits<T>::max()) + 0.5f);
+}
+
+template <>
+float quantiseDepth<float>(float depth) { return depth; }
+
+template <typename T>
+static void storeDepth(simd::FloatVec depth, T* out) {
+	float values[simd::FloatVec::lanes()];
+	depth.store(values);
+	for (size_t i = 0; i < simd::FloatVec::lanes(); ++i) { out[i] = quantiseDepth<T>(values[i]); }
+}
+
+static void storeDepth(simd::FloatVec depth, float* out) { depth.store(out); }
+
+// Estimate depth of a row of pixels using colour attenuation prior.
+template <typename T>
+static void estimateDepth(const Pixel* in, T* out, coord_int width) {
 	constexpr float theta[] = { 0.121779f, 0.959710f, -0.780245f };
 
-	ImageGrey result{ in.width(), in.height() };
+	static_assert(sizeof(Pixel) == 3 * sizeof(float), "Pixel must be tightly packed RGB floats.");
 
-	// Get estimated depth using colour attenuation prior
-	for (auto coord : in.getView()) {
-		const Pixel& p = in[coord];
+	// Bulk of the row in SIMD vectors, same computation as Pixel::getLuminance() and
+	// Pixel::getSaturation() below.
+	using simd::FloatVec;
+	const auto lanes = coord_int(FloatVec::lanes());
+	const auto zero = FloatVec::set(0.0f);
+
+	coord_int x = 0;
+
+	for (; x + lanes <= width; x += lanes) {
+		FloatVec r, g, b;
+		FloatVec::loadInterleaved3(in[x].values.data(), r, g, b);
+
+		const auto luminance = FloatVec::set(0.2126f) * r + FloatVec::set(0.7152f) * g
+			+ FloatVec::set(0.0722f) * b;
+		const auto range = max(max(r, g), b) - min(min(r, g), b);
+		const auto saturation = select(equal(luminance, zero), zero, range / luminance);
+
+		const auto depth = FloatVec::set(theta[0]) + luminance * FloatVec::set(theta[1])
+			+ saturation * FloatVec::set(theta[2]);
+		storeDepth(min(max(depth, zero), FloatVec::set(1.0f)), out + x);
+	}
+
+	for (; x < width; ++x) {
+		const Pixel& p = in[x];
 		const float depth = theta[0] + p.getLuminance() * theta[1] + p.getSaturation() * theta[2];
-		result[coord] = clamp(depth, 0.0f, 1.0f);
+		out[x] = quantiseDepth<T>(clamp(depth, 0.0f, 1.0f));
 	}
+}
 
-	auto tmp = result;
-	auto view = tmp.getView();
+// Estimate depth and min-filter it into filtered, returning the lowest and highest filtered values.
+// The range is tracked for each row as it is written, saving normalisation two passes over the image.
+template <typename T>
+static std::pair<T, T> getFilteredDepth(
+	const ImageRgb& in, coord_int kernelSize, BaseImage<T>& filtered
+) {
+	std::vector<std::pair<T, T>> rowRanges;
+	rowRanges.resize(size_t(in.height()));
+
+	// Estimate depth row by row, streaming it through a square min-filter, so that the unfiltered
+	// depth is never held in full. Bands of rows are processed in parallel.
+	minFilterRows<T>(
+		in.width(), in.height(), kernelSize,
+		[&](coord_int y, T* row) {
+			estimateDepth(&in.getPixelUnsafe(Coord{ 0, y }), row, in.width());
+			return row;
+		},
+		[&](coord_int y, const T* row) {
+			std::copy(row, row + in.width(), &filtered.getPixelUnsafe(Coord{ 0, y }));
+
+			const auto range = std::minmax_element(row, row + in.width());
+			rowRanges[size_t(y)] = { *range.first, *range.second };
+		}
+	);
 
-	// apply square min-filter
-	for (auto coord : view) {
-		float min = 1.0f;
-		auto subView = view.centredSubView(coord, coord_int(kernelSize), coord_int(kernelSize));
+	auto range = std::make_pair(std::numeric_limits<T>::max(), std::numeric_limits<T>::lowest());
+
+	for (const auto& rowRange : rowRanges) {
+		range.first = std::min(range.first, rowRange.first);
+		range.second = std::max(range.second, rowRange.second);
+	}
 
-		for (auto subCoord : subView) {
-			min = std::min(min, tmp[subCoord]);
+	return range;
+}
+
+ImageGrey getDepthFromHazyImage(const ImageRgb& in, size_t kernelSize, DepthPrecision precision) {
+	ImageGrey result{ in.width(), in.height() };
+	const auto windowSize = std::max(coord_int(1), coord_int(kernelSize));
+
+	// Normalising directly from fixed point also dequantises, as the scale factor cancels out.
+	auto normaliseFixedPoint = [&](const auto& filtered, auto range) {
+		const auto min = float(range.first);
+		const auto extent = float(range.second) - min;
+
+		for (size_t i = 0; i < filtered.data().size(); ++i) {
+			result.data()[i] = (float(filtered.data()[i]) - min) / extent;
 		}
+	};
 
-		result[coord] = min;
+	switch (precision) {
+	case DepthPrecision::Float: {
+		const auto range = getFilteredDepth(in, windowSize, result);
+		normalise(result, range.first, range.second);
+		break;
+	}
+	case DepthPrecision::Uint16: {
+		BaseImage<uint16_t> filtered{ in.width(), in.height() };
+		normaliseFixedPoint(filtered, getFilteredDepth(in, windowSize, filtered));
+		break;
+	}
+	case DepthPrecision::Uint8: {
+		BaseImage<uint8_t> filtered{ in.width(), in.height() };
+		normaliseFixedPoint(filtered, getFilteredDepth(in, windowSize, filtered));
+		break;
+	}
 	}
-
-	normalise(result);
 
 	return result;
 }
@@ -45,18 +139,19 @@ ImageRgb removeHaze(const ImageRgb& in, const ImageGrey& depth, float beta) {
 	assert(in.width() == depth.width() && in.height() == depth.height());
 
 	// Find background light colour A
-	std::vector<Coord> coords;
-	for (auto coord : depth.getView()) { coords.push_back(coord); }
+	std::vector<size_t> indices;
+	indices.resize(depth.data().size());
+	std::iota(indices.begin(), indices.end(), size_t(0));
 
-	// Partially sort coords list so that coords for 0.1% farthest pixels come first
+	// Partially sort pixel indices so that those of the 0.1% farthest pixels come first
 	size_t nHighest = depth.data().size() / 1000u;
-	std::nth_element(coords.begin(), coords.begin() + long(nHighest), coords.end(),
-		[&](auto a, auto b) { return depth[a] > depth[b]; }
+	std::nth_element(indices.begin(), indices.begin() + long(nHighest), indices.end(),
+		[&](auto a, auto b) { return depth.data()[a] > depth.data()[b]; }
 	);
 
 	Pixel A;
 	for (size_t i = 0; i < nHighest; ++i) {
-		auto inPixel = in[coords[i]];
+		auto inPixel = in.data()[indices[i]];
 		A = (inPixel.getLuminance() > A.getLuminance()) ? inPixel : A;
 	}
 
@@ -4,8 +4,20 @@
 
 namespace ImgProc { namespace filters {
 
-/** Gets estimated depth from hazy image. */
-ImageGrey getDepthFromHazyImage(const ImageRgb& image, size_t kernelSize);
+/** Precision of depth values while they are min-filtered in getDepthFromHazyImage. */
+enum class DepthPrecision {
+	Float,  ///< 32-bit float, exact.
+	Uint16, ///< 16-bit fixed point. Differs from Float by at most 2 / (65535 * R - 1).
+	Uint8   ///< 8-bit fixed point. Differs from Float by at most 2 / (255 * R - 1).
+};
+
+/** Gets estimated depth from hazy image. With a fixed-point precision, the min filter runs on
+ * quantised depth, using less memory bandwidth. The error bounds of the normalised depth given in
+ * DepthPrecision refer to R, the range of min-filtered depth before normalisation (at most 1).
+ */
+ImageGrey getDepthFromHazyImage(
+	const ImageRgb& image, size_t kernelSize, DepthPrecision precision = DepthPrecision::Float
+);
 
 ImageRgb removeHaze(const ImageRgb& in, const ImageGrey& depth, float beta = 1.0f);
 
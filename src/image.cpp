@@ -151,19 +151,20 @@ void saveGreyImage(const ImageGrey& image, const std::string& filename) {
 }
 
 std::array<ImageGrey, 3> splitChannels(const ImageRgb& image) {
-	std::vector<float> channels[3];
+	std::array<ImageGrey, 3> channels{{
+		ImageGrey{ image.width(), image.height() },
+		ImageGrey{ image.width(), image.height() },
+		ImageGrey{ image.width(), image.height() }
+	}};
 
-	for (Coord coord : image.getView()) {
+	forEachRow(image, [&](coord_int y, const Pixel* begin, const Pixel* end) {
 		for (size_t i = 0; i < 3; ++i) {
-			channels[i].push_back(image[coord].values[i]);
+			float* out = &channels[i].getPixelUnsafe(Coord{ 0, y });
+			for (auto p = begin; p != end; ++p) { *out++ = p->values[i]; }
 		}
-	}
+	});
 
-	return {{
-		ImageGrey{ image.width(), image.height(), std::move(channels[0]) },
-		ImageGrey{ image.width(), image.height(), std::move(channels[1]) },
-		ImageGrey{ image.width(), image.height(), std::move(channels[2]) }
-	}};
+	return channels;
 }
 
 ImageRgb joinChannels(const ImageGrey& r, const ImageGrey& g, const ImageGrey& b) {
@@ -102,6 +102,27 @@ private:
 	std::vector<PixelType> m_data;
 };
 
+/** Call fn(y, begin, end) for each row y of view, where [begin, end) are the pixels of the view in
+ * that row. Lets inner loops run over plain contiguous pointer ranges. View must lie within image, as
+ * views returned by BaseImage::getView do.
+ */
+template <typename ImageT, typename Fn>
+void forEachRow(ImageT& image, const ImageView& view, Fn fn) {
+	assert(view.offset().x + view.width() <= image.width());
+	assert(view.offset().y + view.height() <= image.height());
+
+	if (view.width() <= 0) { return; }
+
+	for (coord_int y = view.offset().y; y < view.offset().y + view.height(); ++y) {
+		auto* begin = &image.getPixelUnsafe(Coord{ view.offset().x, y });
+		fn(y, begin, begin + view.width());
+	}
+}
+
+/** Call fn(y, begin, end) for each row y of image, where [begin, end) are the pixels of that row. */
+template <typename ImageT, typename Fn>
+void forEachRow(ImageT& image, Fn fn) { forEachRow(image, image.getView(), fn); }
+
 //--------------------------------------------------------------------------------------------------
 // Arithmetic operators on Images
 //--------------------------------------------------------------------------------------------------
@@ -256,6 +277,9 @@ using ImageRgb = BaseImage<Pixel>;
 
 using ImageGrey = BaseImage<float>;
 
+/** Packed 8-bit RGB Image type. */
+using ImageRgb8 = BaseImage<PixelRgb8>;
+
 static_assert(std::is_move_constructible<ImageRgb>::value,
 	"ImageRgb should be movable for good performance.");
 
@@ -50,7 +50,7 @@ private:
 
 //--------------------------------------------------------------------------------------------------
 
-/** Iterator over Coords in a ImageView. */
+/** Iterator over Coords in a ImageView. For bulk processing of pixels, prefer forEachRow. */
 class ImageView::iterator {
 public:
 	iterator(const ImageView& view, Coord coord)
@@ -60,9 +60,10 @@ public:
 
 	iterator& operator++() {
 		// Advance to next coord in view
-		auto newX = m_coord.x + 1;
-		m_coord.x = newX % m_view->width();
-		m_coord.y += newX / m_view->width();
+		if (++m_coord.x == m_view->width()) {
+			m_coord.x = 0;
+			++m_coord.y;
+		}
 		return *this;
 	}
 
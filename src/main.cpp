@@ -6,10 +6,13 @@
 #include "image.h"
 
 #include "haze_removal.h"
+#include "thread_pool.h"
 
 using namespace ImgProc;
 
-void dehaze(const std::string& filename, size_t r, float beta, bool saveIntermediates) {
+void dehaze(
+	const std::string& filename, size_t r, float beta, size_t subsample, bool saveIntermediates
+) {
 	auto dotPos = std::find(filename.rbegin(), filename.rend(), '.').base();
 
 	std::string filenameNoExt{
@@ -22,7 +25,7 @@ void dehaze(const std::string& filename, size_t r, float beta, bool saveIntermed
 	ImageRgb hazyImg = loadRgbImage(filename);
 
 	ImageGrey depth = filters::getDepthFromHazyImage(hazyImg, r);
-	ImageGrey depthFiltered = filters::guidedFilter(depth, hazyImg, r, 0.00001f);
+	ImageGrey depthFiltered = filters::guidedFilter(depth, hazyImg, r, 0.00001f, subsample);
 	ImageRgb J = filters::removeHaze(hazyImg, depthFiltered, beta);
 
 	if (saveIntermediates) {
@@ -35,7 +38,8 @@ void dehaze(const std::string& filename, size_t r, float beta, bool saveIntermed
 
 int main(int argn, char* argv[]) {
 	if (argn < 2) {
-		std::cout << "Usage: dehaze file [-r radius] [-b beta]" << std::endl;
+		std::cout << "Usage: dehaze file [-r radius] [-b beta] [-f subsample] [-t threads]"
+			<< std::endl;
 		return 1;
 	}
 
@@ -44,6 +48,8 @@ int main(int argn, char* argv[]) {
 	// Default values for algorithm parametres
 	size_t radius = 9;
 	float beta = 1.0f;
+	size_t subsample = 1; // Guided filter at full resolution
+	size_t threads = 0; // One per hardware thread
 
 	auto handleArg = [](const std::string& str, auto& out) {
 		auto tmp = out;
@@ -65,8 +71,16 @@ int main(int argn, char* argv[]) {
 		else if (std::string{argv[i]} == "-b") {
 			handleArg(argv[++i], beta);
 		}
+		else if (std::string{argv[i]} == "-f") {
+			handleArg(argv[++i], subsample);
+		}
+		else if (std::string{argv[i]} == "-t") {
+			handleArg(argv[++i], threads);
+		}
 	}
 
-	dehaze(filename, radius, beta, true);
+	setThreadCount(threads);
+
+	dehaze(filename, radius, beta, subsample, true);
 }
 
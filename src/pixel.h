@@ -98,5 +98,10 @@ inline std::ostream& operator<<(std::ostream& os, Pixel& p) {
 	return os;
 }
 
+/** Packed 8-bit RGB pixel, as decoded from 8-bit image files such as JPEG. */
+struct PixelRgb8 {
+	std::array<uint8_t, 3> values;
+};
+
 } // namespace ImgProc
 
@@ -0,0 +1,482 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#define IMGPROC_SIMD_SSE2
+#endif
+
+namespace ImgProc {
+
+/** Thin wrappers around SIMD instruction sets, selected at compile time from the best instruction
+ * set enabled for the target (AVX-512, AVX, SSE2, or plain scalar code as fallback; AVX2 rather
+ * than AVX for integer vectors).
+ */
+namespace simd {
+
+#if defined(__AVX512F__)
+
+/** Vector of 16 floats. */
+struct FloatVec {
+	using Mask = __mmask16;
+
+	static constexpr size_t lanes() { return 16; }
+
+	__m512 v;
+
+	static FloatVec set(float x) { return{ _mm512_set1_ps(x) }; }
+	static FloatVec load(const float* p) { return{ _mm512_loadu_ps(p) }; }
+	void store(float* p) const { _mm512_storeu_ps(p, v); }
+
+	/** Load 3 * lanes() floats, deinterleaving them into three vectors (e.g. RGB into planes). */
+	static void loadInterleaved3(const float* p, FloatVec& a, FloatVec& b, FloatVec& c) {
+		const __m512 v0 = _mm512_loadu_ps(p);
+		const __m512 v1 = _mm512_loadu_ps(p + 16);
+		const __m512 v2 = _mm512_loadu_ps(p + 32);
+
+		// Gather each channel from the first 32 floats, then from the last 16.
+		a.v = _mm512_permutex2var_ps(_mm512_permutex2var_ps(v0, _mm512_setr_epi32(
+				0, 3, 6, 9, 12, 15, 18, 21, 24, 27, 30, 0, 0, 0, 0, 0), v1), _mm512_setr_epi32(
+				0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 17, 20, 23, 26, 29), v2);
+		b.v = _mm512_permutex2var_ps(_mm512_permutex2var_ps(v0, _mm512_setr_epi32(
+				1, 4, 7, 10, 13, 16, 19, 22, 25, 28, 31, 0, 0, 0, 0, 0), v1), _mm512_setr_epi32(
+				0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 18, 21, 24, 27, 30), v2);
+		c.v = _mm512_permutex2var_ps(_mm512_permutex2var_ps(v0, _mm512_setr_epi32(
+				2, 5, 8, 11, 14, 17, 20, 23, 26, 29, 0, 0, 0, 0, 0, 0), v1), _mm512_setr_epi32(
+				0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 16, 19, 22, 25, 28, 31), v2);
+	}
+
+	/** Transpose lanes() x lanes() matrix whose rows are rows[0 .. lanes() - 1], in place. Uses
+	 * masked forms with all lanes set, as for min and max below.
+	 */
+	static void transpose(FloatVec* rows) {
+		__m512 t[16], u[16];
+
+		// Within each 128-bit quarter: 2 x 2 blocks of pairs, then of 4 x 4 elements.
+		for (size_t i = 0; i < 16; i += 2) {
+			t[i] = _mm512_mask_unpacklo_ps(rows[i].v, 0xFFFF, rows[i].v, rows[i + 1].v);
+			t[i + 1] = _mm512_mask_unpackhi_ps(rows[i].v, 0xFFFF, rows[i].v, rows[i + 1].v);
+		}
+
+		for (size_t i = 0; i < 16; i += 4) {
+			u[i] = _mm512_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+			u[i + 1] = _mm512_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+			u[i + 2] = _mm512_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+			u[i + 3] = _mm512_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+		}
+
+		// Then 4 x 4 transpose of the quarters.
+		for (size_t m = 0; m < 4; ++m) {
+			const __m512 s0 = _mm512_mask_shuffle_f32x4(u[m], 0xFFFF, u[m], u[4 + m], 0x44);
+			const __m512 s1 = _mm512_mask_shuffle_f32x4(u[m], 0xFFFF, u[m], u[4 + m], 0xEE);
+			const __m512 s2 = _mm512_mask_shuffle_f32x4(u[8 + m], 0xFFFF, u[8 + m], u[12 + m], 0x44);
+			const __m512 s3 = _mm512_mask_shuffle_f32x4(u[8 + m], 0xFFFF, u[8 + m], u[12 + m], 0xEE);
+
+			rows[m].v = _mm512_mask_shuffle_f32x4(s0, 0xFFFF, s0, s2, 0x88);
+			rows[4 + m].v = _mm512_mask_shuffle_f32x4(s0, 0xFFFF, s0, s2, 0xDD);
+			rows[8 + m].v = _mm512_mask_shuffle_f32x4(s1, 0xFFFF, s1, s3, 0x88);
+			rows[12 + m].v = _mm512_mask_shuffle_f32x4(s1, 0xFFFF, s1, s3, 0xDD);
+		}
+	}
+
+	friend FloatVec operator+(FloatVec l, FloatVec r) { return{ _mm512_add_ps(l.v, r.v) }; }
+	friend FloatVec operator-(FloatVec l, FloatVec r) { return{ _mm512_sub_ps(l.v, r.v) }; }
+	friend FloatVec operator*(FloatVec l, FloatVec r) { return{ _mm512_mul_ps(l.v, r.v) }; }
+	friend FloatVec operator/(FloatVec l, FloatVec r) { return{ _mm512_div_ps(l.v, r.v) }; }
+
+	// Masked forms with all lanes set, the plain ones trigger spurious -Wmaybe-uninitialized in GCC.
+	friend FloatVec min(FloatVec l, FloatVec r) { return{ _mm512_mask_min_ps(l.v, 0xFFFF, l.v, r.v) }; }
+	friend FloatVec max(FloatVec l, FloatVec r) { return{ _mm512_mask_max_ps(l.v, 0xFFFF, l.v, r.v) }; }
+
+	friend Mask equal(FloatVec l, FloatVec r) { return _mm512_cmp_ps_mask(l.v, r.v, _CMP_EQ_OQ); }
+
+	/** Per lane, pick ifTrue where mask is set, otherwise ifFalse. */
+	friend FloatVec select(Mask mask, FloatVec ifTrue, FloatVec ifFalse) {
+		return{ _mm512_mask_blend_ps(mask, ifFalse.v, ifTrue.v) };
+	}
+};
+
+#elif defined(__AVX__)
+
+/** Vector of 8 floats. */
+struct FloatVec {
+	using Mask = __m256;
+
+	static constexpr size_t lanes() { return 8; }
+
+	__m256 v;
+
+	static FloatVec set(float x) { return{ _mm256_set1_ps(x) }; }
+	static FloatVec load(const float* p) { return{ _mm256_loadu_ps(p) }; }
+	void store(float* p) const { _mm256_storeu_ps(p, v); }
+
+	/** Load 3 * lanes() floats, deinterleaving them into three vectors (e.g. RGB into planes). */
+	static void loadInterleaved3(const float* p, FloatVec& a, FloatVec& b, FloatVec& c) {
+		// Put the first four elements in the low half and the last four in the high half, so that the
+		// in-lane shuffles below deinterleave both halves at once.
+		auto loadHalves = [](const float* lo) {
+			const __m256 low = _mm256_castps128_ps256(_mm_loadu_ps(lo));
+			return _mm256_insertf128_ps(low, _mm_loadu_ps(lo + 12), 1);
+		};
+
+		const __m256 m0 = loadHalves(p), m1 = loadHalves(p + 4), m2 = loadHalves(p + 8);
+
+		a.v = _mm256_shuffle_ps(
+			m0,
+			_mm256_shuffle_ps(m1, m2, _MM_SHUFFLE(1, 1, 2, 2)),
+			_MM_SHUFFLE(2, 0, 3, 0)
+		);
+		b.v = _mm256_shuffle_ps(
+			_mm256_shuffle_ps(m0, m1, _MM_SHUFFLE(0, 0, 1, 1)),
+			_mm256_shuffle_ps(m1, m2, _MM_SHUFFLE(2, 2, 3, 3)),
+			_MM_SHUFFLE(2, 0, 2, 0)
+		);
+		c.v = _mm256_shuffle_ps(
+			_mm256_shuffle_ps(m0, m1, _MM_SHUFFLE(1, 1, 2, 2)),
+			_mm256_shuffle_ps(m2, m2, _MM_SHUFFLE(3, 3, 0, 0)),
+			_MM_SHUFFLE(2, 0, 2, 0)
+		);
+	}
+
+	/** Transpose lanes() x lanes() matrix whose rows are rows[0 .. lanes() - 1], in place. */
+	static void transpose(FloatVec* rows) {
+		__m256 t[8], u[8];
+
+		// Within each 128-bit half: 2 x 2 blocks of pairs, then of 4 x 4 elements.
+		for (size_t i = 0; i < 8; i += 2) {
+			t[i] = _mm256_unpacklo_ps(rows[i].v, rows[i + 1].v);
+			t[i + 1] = _mm256_unpackhi_ps(rows[i].v, rows[i + 1].v);
+		}
+
+		for (size_t i = 0; i < 8; i += 4) {
+			u[i] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+			u[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+			u[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+			u[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+		}
+
+		// Then swap the upper-left and lower-right halves.
+		for (size_t m = 0; m < 4; ++m) {
+			rows[m].v = _mm256_permute2f128_ps(u[m], u[4 + m], 0x20);
+			rows[4 + m].v = _mm256_permute2f128_ps(u[m], u[4 + m], 0x31);
+		}
+	}
+
+	friend FloatVec operator+(FloatVec l, FloatVec r) { return{ _mm256_add_ps(l.v, r.v) }; }
+	friend FloatVec operator-(FloatVec l, FloatVec r) { return{ _mm256_sub_ps(l.v, r.v) }; }
+	friend FloatVec operator*(FloatVec l, FloatVec r) { return{ _mm256_mul_ps(l.v, r.v) }; }
+	friend FloatVec operator/(FloatVec l, FloatVec r) { return{ _mm256_div_ps(l.v, r.v) }; }
+
+	friend FloatVec min(FloatVec l, FloatVec r) { return{ _mm256_min_ps(l.v, r.v) }; }
+	friend FloatVec max(FloatVec l, FloatVec r) { return{ _mm256_max_ps(l.v, r.v) }; }
+
+	friend Mask equal(FloatVec l, FloatVec r) { return _mm256_cmp_ps(l.v, r.v, _CMP_EQ_OQ); }
+
+	/** Per lane, pick ifTrue where mask is set, otherwise ifFalse. */
+	friend FloatVec select(Mask mask, FloatVec ifTrue, FloatVec ifFalse) {
+		return{ _mm256_blendv_ps(ifFalse.v, ifTrue.v, mask) };
+	}
+};
+
+#elif defined(IMGPROC_SIMD_SSE2)
+
+/** Vector of 4 floats. */
+struct FloatVec {
+	using Mask = __m128;
+
+	static constexpr size_t lanes() { return 4; }
+
+	__m128 v;
+
+	static FloatVec set(float x) { return{ _mm_set1_ps(x) }; }
+	static FloatVec load(const float* p) { return{ _mm_loadu_ps(p) }; }
+	void store(float* p) const { _mm_storeu_ps(p, v); }
+
+	/** Load 3 * lanes() floats, deinterleaving them into three vectors (e.g. RGB into planes). */
+	static void loadInterleaved3(const float* p, FloatVec& a, FloatVec& b, FloatVec& c) {
+		const __m128 m0 = _mm_loadu_ps(p), m1 = _mm_loadu_ps(p + 4), m2 = _mm_loadu_ps(p + 8);
+
+		a.v = _mm_shuffle_ps(
+			m0,
+			_mm_shuffle_ps(m1, m2, _MM_SHUFFLE(1, 1, 2, 2)),
+			_MM_SHUFFLE(2, 0, 3, 0)
+		);
+		b.v = _mm_shuffle_ps(
+			_mm_shuffle_ps(m0, m1, _MM_SHUFFLE(0, 0, 1, 1)),
+			_mm_shuffle_ps(m1, m2, _MM_SHUFFLE(2, 2, 3, 3)),
+			_MM_SHUFFLE(2, 0, 2, 0)
+		);
+		c.v = _mm_shuffle_ps(
+			_mm_shuffle_ps(m0, m1, _MM_SHUFFLE(1, 1, 2, 2)),
+			_mm_shuffle_ps(m2, m2, _MM_SHUFFLE(3, 3, 0, 0)),
+			_MM_SHUFFLE(2, 0, 2, 0)
+		);
+	}
+
+	/** Transpose lanes() x lanes() matrix whose rows are rows[0 .. lanes() - 1], in place. */
+	static void transpose(FloatVec* rows) {
+		_MM_TRANSPOSE4_PS(rows[0].v, rows[1].v, rows[2].v, rows[3].v);
+	}
+
+	friend FloatVec operator+(FloatVec l, FloatVec r) { return{ _mm_add_ps(l.v, r.v) }; }
+	friend FloatVec operator-(FloatVec l, FloatVec r) { return{ _mm_sub_ps(l.v, r.v) }; }
+	friend FloatVec operator*(FloatVec l, FloatVec r) { return{ _mm_mul_ps(l.v, r.v) }; }
+	friend FloatVec operator/(FloatVec l, FloatVec r) { return{ _mm_div_ps(l.v, r.v) }; }
+
+	friend FloatVec min(FloatVec l, FloatVec r) { return{ _mm_min_ps(l.v, r.v) }; }
+	friend FloatVec max(FloatVec l, FloatVec r) { return{ _mm_max_ps(l.v, r.v) }; }
+
+	friend Mask equal(FloatVec l, FloatVec r) { return _mm_cmpeq_ps(l.v, r.v); }
+
+	/** Per lane, pick ifTrue where mask is set, otherwise ifFalse. */
+	friend FloatVec select(Mask mask, FloatVec ifTrue, FloatVec ifFalse) {
+		return{ _mm_or_ps(_mm_and_ps(mask, ifTrue.v), _mm_andnot_ps(mask, ifFalse.v)) };
+	}
+};
+
+#else
+
+/** Scalar fallback, a "vector" of one float. */
+struct FloatVec {
+	using Mask = bool;
+
+	static constexpr size_t lanes() { return 1; }
+
+	float v;
+
+	static FloatVec set(float x) { return{ x }; }
+	static FloatVec load(const float* p) { return{ *p }; }
+	void store(float* p) const { *p = v; }
+
+	/** Load 3 * lanes() floats, deinterleaving them into three vectors (e.g. RGB into planes). */
+	static void loadInterleaved3(const float* p, FloatVec& a, FloatVec& b, FloatVec& c) {
+		a.v = p[0]; b.v = p[1]; c.v = p[2];
+	}
+
+	/** Transpose lanes() x lanes() matrix whose rows are rows[0 .. lanes() - 1], in place. */
+	static void transpose(FloatVec*) {}
+
+	friend FloatVec operator+(FloatVec l, FloatVec r) { return{ l.v + r.v }; }
+	friend FloatVec operator-(FloatVec l, FloatVec r) { return{ l.v - r.v }; }
+	friend FloatVec operator*(FloatVec l, FloatVec r) { return{ l.v * r.v }; }
+	friend FloatVec operator/(FloatVec l, FloatVec r) { return{ l.v / r.v }; }
+
+	friend FloatVec min(FloatVec l, FloatVec r) { return{ std::min(l.v, r.v) }; }
+	friend FloatVec max(FloatVec l, FloatVec r) { return{ std::max(l.v, r.v) }; }
+
+	friend Mask equal(FloatVec l, FloatVec r) { return l.v == r.v; }
+
+	/** Per lane, pick ifTrue where mask is set, otherwise ifFalse. */
+	friend FloatVec select(Mask mask, FloatVec ifTrue, FloatVec ifFalse) {
+		return mask ? ifTrue : ifFalse;
+	}
+};
+
+#endif
+
+#if defined(__AVX512F__)
+
+/** Vector of 16 uint32_t. Uses zero-masked forms with all lanes set where GCC warns about the
+ * undefined source operand of the plain forms.
+ */
+struct Uint32Vec {
+	static constexpr size_t lanes() { return 16; }
+
+	__m512i v;
+
+	static Uint32Vec load(const uint32_t* p) { return{ _mm512_loadu_si512(p) }; }
+	void store(uint32_t* p) const { _mm512_storeu_si512(p, v); }
+
+	/** Load lanes() 8-bit or 16-bit values, zero-extending them. */
+	static Uint32Vec load(const uint8_t* p) {
+		const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		return{ _mm512_maskz_cvtepu8_epi32(0xFFFF, bytes) };
+	}
+	static Uint32Vec load(const uint16_t* p) {
+		const __m256i words = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+		return{ _mm512_maskz_cvtepu16_epi32(0xFFFF, words) };
+	}
+
+	/** Store lanes as 8-bit or 16-bit values, which they must fit in. */
+	void store(uint8_t* p) const {
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm512_maskz_cvtepi32_epi8(0xFFFF, v));
+	}
+	void store(uint16_t* p) const {
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(p), _mm512_maskz_cvtepi32_epi16(0xFFFF, v));
+	}
+
+	friend Uint32Vec operator+(Uint32Vec l, Uint32Vec r) { return{ _mm512_add_epi32(l.v, r.v) }; }
+	friend Uint32Vec operator-(Uint32Vec l, Uint32Vec r) { return{ _mm512_sub_epi32(l.v, r.v) }; }
+
+	/** Per lane, (x * factor + 2^(shift - 1)) >> shift in 64-bit arithmetic, for shift from 1 to 63
+	 * and results that fit in 32 bits. Even and odd lanes are multiplied separately.
+	 */
+	friend Uint32Vec mulShiftRound(Uint32Vec x, uint32_t factor, unsigned shift) {
+		const __m512i f = _mm512_set1_epi32(int(factor));
+		const __m512i round = _mm512_set1_epi64(int64_t(uint64_t(1) << (shift - 1)));
+		const __m128i count = _mm_cvtsi32_si128(int(shift));
+
+		const __m512i even = _mm512_maskz_mul_epu32(0xFF, x.v, f);
+		const __m512i odd = _mm512_maskz_mul_epu32(0xFF, _mm512_maskz_srli_epi64(0xFF, x.v, 32), f);
+
+		return{ _mm512_or_si512(
+			_mm512_maskz_srl_epi64(0xFF, _mm512_add_epi64(even, round), count),
+			_mm512_maskz_slli_epi64(0xFF,
+				_mm512_maskz_srl_epi64(0xFF, _mm512_add_epi64(odd, round), count), 32)
+		) };
+	}
+};
+
+#elif defined(__AVX2__)
+
+/** Vector of 8 uint32_t. */
+struct Uint32Vec {
+	static constexpr size_t lanes() { return 8; }
+
+	__m256i v;
+
+	static Uint32Vec load(const uint32_t* p) {
+		return{ _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)) };
+	}
+	void store(uint32_t* p) const { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+
+	/** Load lanes() 8-bit or 16-bit values, zero-extending them. */
+	static Uint32Vec load(const uint8_t* p) {
+		return{ _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))) };
+	}
+	static Uint32Vec load(const uint16_t* p) {
+		return{ _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))) };
+	}
+
+	/** Store lanes as 8-bit or 16-bit values, which they must fit in. */
+	void store(uint8_t* p) const {
+		const __m128i words = packWords();
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packus_epi16(words, words));
+	}
+	void store(uint16_t* p) const { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), packWords()); }
+
+	friend Uint32Vec operator+(Uint32Vec l, Uint32Vec r) { return{ _mm256_add_epi32(l.v, r.v) }; }
+	friend Uint32Vec operator-(Uint32Vec l, Uint32Vec r) { return{ _mm256_sub_epi32(l.v, r.v) }; }
+
+	/** Per lane, (x * factor + 2^(shift - 1)) >> shift in 64-bit arithmetic, for shift from 1 to 63
+	 * and results that fit in 32 bits. Even and odd lanes are multiplied separately.
+	 */
+	friend Uint32Vec mulShiftRound(Uint32Vec x, uint32_t factor, unsigned shift) {
+		const __m256i f = _mm256_set1_epi32(int(factor));
+		const __m256i round = _mm256_set1_epi64x(int64_t(uint64_t(1) << (shift - 1)));
+		const __m128i count = _mm_cvtsi32_si128(int(shift));
+
+		const __m256i even = _mm256_mul_epu32(x.v, f);
+		const __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(x.v, 32), f);
+
+		return{ _mm256_or_si256(
+			_mm256_srl_epi64(_mm256_add_epi64(even, round), count),
+			_mm256_slli_epi64(_mm256_srl_epi64(_mm256_add_epi64(odd, round), count), 32)
+		) };
+	}
+
+private:
+	// Lanes as 16-bit values.
+	__m128i packWords() const {
+		return _mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+	}
+};
+
+#elif defined(IMGPROC_SIMD_SSE2)
+
+/** Vector of 4 uint32_t. */
+struct Uint32Vec {
+	static constexpr size_t lanes() { return 4; }
+
+	__m128i v;
+
+	static Uint32Vec load(const uint32_t* p) {
+		return{ _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)) };
+	}
+	void store(uint32_t* p) const { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+
+	/** Load lanes() 8-bit or 16-bit values, zero-extending them. */
+	static Uint32Vec load(const uint8_t* p) {
+		int32_t bytes;
+		std::memcpy(&bytes, p, sizeof(bytes));
+
+		const __m128i zero = _mm_setzero_si128();
+		return{ _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero) };
+	}
+	static Uint32Vec load(const uint16_t* p) {
+		const __m128i words = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+		return{ _mm_unpacklo_epi16(words, _mm_setzero_si128()) };
+	}
+
+	/** Store lanes as 8-bit or 16-bit values, which they must fit in. */
+	void store(uint8_t* p) const {
+		const __m128i words = _mm_packs_epi32(v, v);
+		const int32_t bytes = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+		std::memcpy(p, &bytes, sizeof(bytes));
+	}
+	void store(uint16_t* p) const {
+		// No unsigned saturating pack before SSE4.1, so gather the low halves of the lanes instead.
+		__m128i words = _mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 2, 0));
+		words = _mm_shufflehi_epi16(words, _MM_SHUFFLE(3, 3, 2, 0));
+		words = _mm_shuffle_epi32(words, _MM_SHUFFLE(3, 3, 2, 0));
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(p), words);
+	}
+
+	friend Uint32Vec operator+(Uint32Vec l, Uint32Vec r) { return{ _mm_add_epi32(l.v, r.v) }; }
+	friend Uint32Vec operator-(Uint32Vec l, Uint32Vec r) { return{ _mm_sub_epi32(l.v, r.v) }; }
+
+	/** Per lane, (x * factor + 2^(shift - 1)) >> shift in 64-bit arithmetic, for shift from 1 to 63
+	 * and results that fit in 32 bits. Even and odd lanes are multiplied separately.
+	 */
+	friend Uint32Vec mulShiftRound(Uint32Vec x, uint32_t factor, unsigned shift) {
+		const __m128i f = _mm_set1_epi32(int(factor));
+		const __m128i round = _mm_set1_epi64x(int64_t(uint64_t(1) << (shift - 1)));
+		const __m128i count = _mm_cvtsi32_si128(int(shift));
+
+		const __m128i even = _mm_mul_epu32(x.v, f);
+		const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(x.v, 32), f);
+
+		return{ _mm_or_si128(
+			_mm_srl_epi64(_mm_add_epi64(even, round), count),
+			_mm_slli_epi64(_mm_srl_epi64(_mm_add_epi64(odd, round), count), 32)
+		) };
+	}
+};
+
+#else
+
+/** Scalar fallback, a "vector" of one uint32_t. */
+struct Uint32Vec {
+	static constexpr size_t lanes() { return 1; }
+
+	uint32_t v;
+
+	static Uint32Vec load(const uint32_t* p) { return{ *p }; }
+	void store(uint32_t* p) const { *p = v; }
+
+	/** Load lanes() 8-bit or 16-bit values, zero-extending them. */
+	static Uint32Vec load(const uint8_t* p) { return{ *p }; }
+	static Uint32Vec load(const uint16_t* p) { return{ *p }; }
+
+	/** Store lanes as 8-bit or 16-bit values, which they must fit in. */
+	void store(uint8_t* p) const { *p = uint8_t(v); }
+	void store(uint16_t* p) const { *p = uint16_t(v); }
+
+	friend Uint32Vec operator+(Uint32Vec l, Uint32Vec r) { return{ l.v + r.v }; }
+	friend Uint32Vec operator-(Uint32Vec l, Uint32Vec r) { return{ l.v - r.v }; }
+
+	/** (x * factor + 2^(shift - 1)) >> shift in 64-bit arithmetic, for shift from 1 to 63 and
+	 * results that fit in 32 bits.
+	 */
+	friend Uint32Vec mulShiftRound(Uint32Vec x, uint32_t factor, unsigned shift) {
+		return{ uint32_t((uint64_t(x.v) * factor + (uint64_t(1) << (shift - 1))) >> shift) };
+	}
+};
+
+#endif
+
+}} // namespace ImgProc::simd
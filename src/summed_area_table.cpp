@@ -0,0 +1,57 @@
+#include "summed_area_table.h"
+
+#include <cassert>
+
+#include "thread_pool.h"
+
+namespace ImgProc { namespace filters {
+
+SummedAreaTable::SummedAreaTable(const ImageGrey& image)
+	: m_width(image.width()), m_height(image.height())
+{
+	const auto stride = size_t(m_width) + 1;
+	m_sums.resize(stride * (size_t(m_height) + 1));
+
+	if (m_width == 0) { return; }
+
+	// Each sum is the one above it plus the running sum of its row so far.
+	for (coord_int y = 0; y < m_height; ++y) {
+		const float* row = &image.getPixelUnsafe(Coord{ 0, y });
+		const double* above = &m_sums[size_t(y) * stride];
+		double* sums = &m_sums[(size_t(y) + 1) * stride];
+		double rowSum = 0.0;
+
+		for (size_t x = 0; x < size_t(m_width); ++x) {
+			rowSum += double(row[x]);
+			sums[x + 1] = above[x + 1] + rowSum;
+		}
+	}
+}
+
+double SummedAreaTable::sum(const ImageView& view) const {
+	const auto x1 = view.offset().x + view.width(), y1 = view.offset().y + view.height();
+
+	assert(x1 <= m_width && y1 <= m_height);
+
+	return boxSum(view.offset().x, view.offset().y, x1, y1);
+}
+
+ImageGrey SummedAreaTable::means(const BaseImage<coord_int>& radii) const {
+	assert(radii.width() == m_width && radii.height() == m_height);
+
+	ImageGrey out{ m_width, m_height };
+
+	if (m_width == 0) { return out; }
+
+	getThreadPool().parallelFor(size_t(m_height), [&](size_t row) {
+		const auto y = coord_int(row);
+		const coord_int* rowRadii = &radii.getPixelUnsafe(Coord{ 0, y });
+		float* rowOut = &out.getPixelUnsafe(Coord{ 0, y });
+
+		for (coord_int x = 0; x < m_width; ++x) { rowOut[x] = mean(Coord{ x, y }, rowRadii[x]); }
+	});
+
+	return out;
+}
+
+}} // namespace ImgProc::filters
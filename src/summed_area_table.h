@@ -0,0 +1,69 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "image.h"
+
+namespace ImgProc { namespace filters {
+
+/** Summed-area table (integral image) of a greyscale image. Built in one pass over the image, it
+ * then gives the sum or mean of any rectangle of pixels in O(1), e.g. for box filtering with a
+ * radius that varies from pixel to pixel. Sums are accumulated in doubles, whose 53-bit mantissas
+ * keep the differences of large sums that queries take accurate to well within float precision.
+ * Takes 8 bytes per pixel.
+ */
+class SummedAreaTable {
+public:
+	explicit SummedAreaTable(const ImageGrey& image);
+
+	/** Get width of the image summed. */
+	coord_int width() const { return m_width; }
+
+	/** Get height of the image summed. */
+	coord_int height() const { return m_height; }
+
+	/** Sum of the pixels in view, which must lie within the image, as views returned by
+	 * BaseImage::getView do.
+	 */
+	double sum(const ImageView& view) const;
+
+	/** Mean of the square of (2 * r + 1)^2 pixels centred on centre, clipped to the image. Equals
+	 * that of boxFilter with window size 2 * r + 1 at centre, up to rounding. Negative radii are
+	 * taken as 0, giving the pixel itself.
+	 */
+	float mean(Coord centre, coord_int r) const {
+		r = std::max(r, coord_int(0));
+
+		const auto x0 = std::max(centre.x - r, coord_int(0));
+		const auto y0 = std::max(centre.y - r, coord_int(0));
+		const auto x1 = std::min(centre.x + r + 1, m_width);
+		const auto y1 = std::min(centre.y + r + 1, m_height);
+
+		return float(boxSum(x0, y0, x1, y1) / (double(x1 - x0) * double(y1 - y0)));
+	}
+
+	/** Box filter with radius radii[c] at each pixel c, radii being the size of the image. Negative
+	 * radii are taken as 0, as by mean.
+	 */
+	ImageGrey means(const BaseImage<coord_int>& radii) const;
+
+private:
+	// Sum of the pixels in [x0, x1) x [y0, y1). Differences of sums in the same rows are taken
+	// first, as they are closer in magnitude.
+	double boxSum(coord_int x0, coord_int y0, coord_int x1, coord_int y1) const {
+		return (at(x1, y1) - at(x0, y1)) - (at(x1, y0) - at(x0, y0));
+	}
+
+	// Sum of the pixels above and left of (x, y), i.e. in [0, x) x [0, y).
+	double at(coord_int x, coord_int y) const {
+		return m_sums[size_t(y) * (size_t(m_width) + 1) + size_t(x)];
+	}
+
+	coord_int m_width, m_height;
+
+	// (width + 1) x (height + 1) sums, the first row and column being zero.
+	std::vector<double> m_sums;
+};
+
+}} // namespace ImgProc::filters
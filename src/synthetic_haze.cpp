@@ -0,0 +1,160 @@
+#include "synthetic_haze.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "thread_pool.h"
+
+namespace ImgProc {
+
+namespace {
+
+// Random value in [0, 1) from the top 24 bits of the next output of rng. The standard fixes the
+// output of std::mt19937 but not how std::uniform_real_distribution maps it, so mapping it here
+// keeps scenes the same with any standard library.
+float uniformRandom(std::mt19937& rng) {
+	return float(uint32_t(rng()) >> 8) * (1.0f / 16777216.0f);
+}
+
+// Smooth random noise in [0, 1]: random values on a grid of cells, interpolated with smoothstep.
+class ValueNoise {
+public:
+	ValueNoise(coord_int width, coord_int height, coord_int cellSize, std::mt19937& rng)
+		: m_cellSize(float(cellSize))
+		, m_gridWidth(width / cellSize + 2)
+		, m_gridHeight(height / cellSize + 2)
+	{
+		m_grid.resize(size_t(m_gridWidth * m_gridHeight));
+		for (auto& v : m_grid) { v = uniformRandom(rng); }
+	}
+
+	float operator()(coord_int x, coord_int y) const {
+		const float gx = float(x) / m_cellSize, gy = float(y) / m_cellSize;
+		const auto cx = coord_int(gx), cy = coord_int(gy);
+		const float fx = smoothstep(gx - float(cx)), fy = smoothstep(gy - float(cy));
+
+		const float top = lerp(at(cx, cy), at(cx + 1, cy), fx);
+		const float bottom = lerp(at(cx, cy + 1), at(cx + 1, cy + 1), fx);
+		return lerp(top, bottom, fy);
+	}
+
+private:
+	static float smoothstep(float t) { return t * t * (3.0f - 2.0f * t); }
+	static float lerp(float a, float b, float t) { return a + (b - a) * t; }
+
+	float at(coord_int x, coord_int y) const { return m_grid[size_t(y * m_gridWidth + x)]; }
+
+	float m_cellSize;
+	coord_int m_gridWidth, m_gridHeight;
+	std::vector<float> m_grid;
+};
+
+// Sum of noise octaves, each half the cell size and half the amplitude of the previous one.
+class FractalNoise {
+public:
+	FractalNoise(coord_int width, coord_int height, coord_int cellSize, size_t numOctaves, std::mt19937& rng) {
+		for (size_t i = 0; i < numOctaves; ++i) {
+			m_octaves.emplace_back(width, height, std::max(coord_int(1), cellSize >> i), rng);
+		}
+	}
+
+	float operator()(coord_int x, coord_int y) const {
+		float sum = 0.0f, amplitude = 0.5f, totalAmplitude = 0.0f;
+
+		for (const auto& octave : m_octaves) {
+			sum += amplitude * octave(x, y);
+			totalAmplitude += amplitude;
+			amplitude *= 0.5f;
+		}
+
+		return sum / totalAmplitude;
+	}
+
+private:
+	std::vector<ValueNoise> m_octaves;
+};
+
+// Fill image row by row in parallel with fn(x, y).
+template <typename PixelT, typename Fn>
+void generate(BaseImage<PixelT>& image, Fn fn) {
+	getThreadPool().parallelFor(size_t(image.height()), [&](size_t row) {
+		const auto y = coord_int(row);
+		PixelT* out = &image.getPixelUnsafe(Coord{ 0, y });
+		for (coord_int x = 0; x < image.width(); ++x) { out[x] = fn(x, y); }
+	});
+}
+
+} // namespace
+
+ImageRgb addHaze(const ImageRgb& clear, const ImageGrey& depth, Pixel airlight, float beta) {
+	assert(clear.width() == depth.width() && clear.height() == depth.height());
+
+	ImageRgb out{ clear.width(), clear.height() };
+
+	for (size_t i = 0; i < out.data().size(); ++i) {
+		const float t = std::max(0.1f, std::min(0.9f, std::exp(-beta * depth.data()[i])));
+		out.data()[i] = clear.data()[i] * t + airlight * (1.0f - t);
+	}
+
+	return out;
+}
+
+ImageRgb generateClearImage(coord_int width, coord_int height, uint32_t seed) {
+	std::mt19937 rng{ seed };
+	const auto cellSize = std::max(coord_int(8), std::max(width, height) / 8);
+
+	const FractalNoise hue{ width, height, cellSize, 3, rng };
+	const FractalNoise brightness{ width, height, cellSize / 2, 5, rng };
+
+	ImageRgb image{ width, height };
+
+	generate(image, [&](coord_int x, coord_int y) {
+		// Colour wheel from noise; channels phase-shifted thirds of a cosine
+		const float angle = 2.0f * 3.14159265f * 2.0f * hue(x, y);
+		const float value = 0.15f + 0.8f * brightness(x, y);
+
+		return Pixel{
+			value * (0.5f + 0.5f * std::cos(angle)),
+			value * (0.5f + 0.5f * std::cos(angle - 2.0943951f)),
+			value * (0.5f + 0.5f * std::cos(angle + 2.0943951f))
+		};
+	});
+
+	return image;
+}
+
+ImageGrey generateDepthMap(coord_int width, coord_int height, uint32_t seed) {
+	std::mt19937 rng{ seed };
+	const FractalNoise terrain{ width, height, std::max(coord_int(8), width / 4), 4, rng };
+
+	ImageGrey depth{ width, height };
+
+	generate(depth, [&](coord_int x, coord_int y) {
+		const float horizon = 1.0f - float(y) / float(std::max(coord_int(1), height - 1));
+		return clamp(0.75f * horizon + 0.5f * (terrain(x, y) - 0.5f), 0.0f, 1.0f);
+	});
+
+	return depth;
+}
+
+HazyScene generateHazyScene(const ImageRgb& clear, uint32_t seed, float beta) {
+	std::mt19937 rng{ seed };
+
+	// Bright, slightly bluish-grey atmospheric light
+	const float a = 0.75f + 0.2f * uniformRandom(rng);
+	const Pixel airlight{ a * 0.95f, a * 0.97f, a };
+
+	auto depth = generateDepthMap(clear.width(), clear.height(), uint32_t(rng()));
+	auto hazy = addHaze(clear, depth, airlight, beta);
+
+	return HazyScene{ clear, std::move(depth), airlight, std::move(hazy) };
+}
+
+HazyScene generateHazyScene(coord_int width, coord_int height, uint32_t seed, float beta) {
+	std::mt19937 rng{ seed };
+	const auto clearSeed = uint32_t(rng());
+	return generateHazyScene(generateClearImage(width, height, clearSeed), uint32_t(rng()), beta);
+}
+
+} // namespace ImgProc
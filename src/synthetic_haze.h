@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+#include "image.h"
+
+namespace ImgProc {
+
+/** Synthetic scene following the image formation model inverted by filters::removeHaze, for
+ * reproducible benchmark inputs and for accuracy checks against known ground truth.
+ */
+struct HazyScene {
+	ImageRgb clear;  ///< Haze-free scene radiance J.
+	ImageGrey depth; ///< Scene depth d in [0, 1].
+	Pixel airlight;  ///< Atmospheric light A.
+	ImageRgb hazy;   ///< Observed image I = J * t + A * (1 - t), with transmission t = exp(-beta * d).
+};
+
+/** Add haze to clear image: I = J * t + A * (1 - t), with t = exp(-beta * depth) clamped to
+ * [0.1, 0.9] as in filters::removeHaze, so that removeHaze given the same depth and A recovers J.
+ */
+ImageRgb addHaze(const ImageRgb& clear, const ImageGrey& depth, Pixel airlight, float beta = 1.0f);
+
+/** Generate procedural clear scene of given size: smooth, saturated colour noise. */
+ImageRgb generateClearImage(coord_int width, coord_int height, uint32_t seed);
+
+/** Generate synthetic depth map of given size: increasing towards the top of the image, like
+ * terrain receding towards the horizon, with smooth noise on top.
+ */
+ImageGrey generateDepthMap(coord_int width, coord_int height, uint32_t seed);
+
+/** Generate hazy scene from clear image (e.g. a loaded one) and a synthetic depth map. */
+HazyScene generateHazyScene(const ImageRgb& clear, uint32_t seed, float beta = 1.0f);
+
+/** Generate fully synthetic hazy scene of given size. Output depends only on the arguments, with
+ * any standard library, up to rounding differences of the floating-point arithmetic between
+ * compilers and instruction sets.
+ */
+HazyScene generateHazyScene(coord_int width, coord_int height, uint32_t seed, float beta = 1.0f);
+
+} // namespace ImgProc
@@ -0,0 +1,154 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <exception>
+
+namespace ImgProc {
+
+// One parallelFor call. Items are claimed by whichever threads are available, the calling thread
+// included, so a job always completes even if every worker is busy elsewhere.
+class ThreadPool::Job {
+public:
+	Job(size_t count, const std::function<void(size_t)>& fn) : m_count(count), m_fn(fn) {}
+
+	// Run items until there are none left to claim.
+	void run() {
+		size_t numCompleted = 0;
+
+		for (size_t i = m_next++; i < m_count; i = m_next++) {
+			try { m_fn(i); }
+			catch (...) {
+				std::lock_guard<std::mutex> lock{ m_mutex };
+				if (!m_error) { m_error = std::current_exception(); }
+			}
+
+			++numCompleted;
+		}
+
+		if (numCompleted == 0) { return; }
+
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		m_numCompleted += numCompleted;
+		if (m_numCompleted == m_count) { m_finished.notify_all(); }
+	}
+
+	bool exhausted() const { return m_next >= m_count; }
+
+	// Wait for all items to complete, rethrowing any exception thrown by them.
+	void wait() {
+		std::unique_lock<std::mutex> lock{ m_mutex };
+		m_finished.wait(lock, [&] { return m_numCompleted == m_count; });
+		if (m_error) { std::rethrow_exception(m_error); }
+	}
+
+private:
+	const size_t m_count;
+	const std::function<void(size_t)>& m_fn;
+
+	std::atomic<size_t> m_next{ 0 };
+	size_t m_numCompleted = 0;
+	std::exception_ptr m_error;
+
+	std::mutex m_mutex;
+	std::condition_variable m_finished;
+};
+
+ThreadPool::ThreadPool(size_t numThreads) {
+	for (size_t i = 1; i < numThreads; ++i) {
+		m_workers.emplace_back([this] { workerLoop(); });
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		m_stop = true;
+	}
+
+	m_wake.notify_all();
+	for (auto& worker : m_workers) { worker.join(); }
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& fn) {
+	if (count == 0) { return; }
+
+	// Nothing to share, avoid synchronisation overhead.
+	if (count == 1 || m_workers.empty()) {
+		for (size_t i = 0; i < count; ++i) { fn(i); }
+		return;
+	}
+
+	auto job = std::make_shared<Job>(count, fn);
+
+	{
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		m_jobs.push_back(job);
+	}
+
+	m_wake.notify_all();
+
+	job->run();
+	removeJob(job);
+	job->wait();
+}
+
+void ThreadPool::workerLoop() {
+	for (;;) {
+		std::shared_ptr<Job> job;
+
+		{
+			std::unique_lock<std::mutex> lock{ m_mutex };
+			m_wake.wait(lock, [&] { return m_stop || !m_jobs.empty(); });
+			if (m_jobs.empty()) { return; }
+			job = m_jobs.front();
+		}
+
+		job->run();
+		removeJob(job);
+	}
+}
+
+// Remove job from queue once it has no items left to claim, so that workers move on to the next.
+void ThreadPool::removeJob(const std::shared_ptr<Job>& job) {
+	std::lock_guard<std::mutex> lock{ m_mutex };
+	assert(job->exhausted());
+
+	auto it = std::find(m_jobs.begin(), m_jobs.end(), job);
+	if (it != m_jobs.end()) { m_jobs.erase(it); }
+}
+
+//--------------------------------------------------------------------------------------------------
+
+static std::mutex sharedPoolMutex;
+static size_t sharedPoolThreads = 0;
+static std::unique_ptr<ThreadPool> sharedPool;
+
+static size_t resolveThreadCount(size_t numThreads) {
+	return numThreads != 0 ? numThreads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+void setThreadCount(size_t numThreads) {
+	std::lock_guard<std::mutex> lock{ sharedPoolMutex };
+
+	sharedPoolThreads = numThreads;
+	sharedPool.reset();
+}
+
+size_t getThreadCount() {
+	std::lock_guard<std::mutex> lock{ sharedPoolMutex };
+	return resolveThreadCount(sharedPoolThreads);
+}
+
+ThreadPool& getThreadPool() {
+	std::lock_guard<std::mutex> lock{ sharedPoolMutex };
+
+	if (!sharedPool) {
+		sharedPool.reset(new ThreadPool{ resolveThreadCount(sharedPoolThreads) });
+	}
+
+	return *sharedPool;
+}
+
+} // namespace ImgProc
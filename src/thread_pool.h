@@ -0,0 +1,56 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ImgProc {
+
+/** Fixed set of worker threads for data-parallel loops. */
+class ThreadPool {
+public:
+	/** Create pool using numThreads threads in total, the thread calling parallelFor included. */
+	explicit ThreadPool(size_t numThreads);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/** Number of threads work is spread over, including the calling thread. */
+	size_t numThreads() const { return m_workers.size() + 1; }
+
+	/** Call fn(i) for every i in [0, count), spread over the pool's threads, and wait for all calls to
+	 * complete. May be called recursively from within fn. If any call throws, the first exception is
+	 * rethrown once all calls have completed.
+	 */
+	void parallelFor(size_t count, const std::function<void(size_t)>& fn);
+
+private:
+	class Job;
+
+	void workerLoop();
+	void removeJob(const std::shared_ptr<Job>& job);
+
+	std::vector<std::thread> m_workers;
+	std::deque<std::shared_ptr<Job>> m_jobs;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	bool m_stop = false;
+};
+
+/** Set number of threads used by image processing functions. 0 means one per hardware thread.
+ * Must not be called while image processing functions are running.
+ */
+void setThreadCount(size_t numThreads);
+
+/** Get number of threads used by image processing functions. */
+size_t getThreadCount();
+
+/** Get thread pool shared by image processing functions. */
+ThreadPool& getThreadPool();
+
+} // namespace ImgProc
@@ -0,0 +1,844 @@
+#include "verify.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "filters.h"
+#include "guided_filter_cache.h"
+#include "haze_removal.h"
+#include "image.h"
+#include "summed_area_table.h"
+#include "synthetic_haze.h"
+#include "thread_pool.h"
+
+namespace ImgProc {
+
+namespace {
+
+// Image sizes checked: a single pixel, single rows and columns, sizes that are not multiples of SIMD
+// vector widths, and images smaller than most windows.
+const Coord sizes[] = { { 1, 1 }, { 1, 45 }, { 45, 1 }, { 3, 2 }, { 33, 17 }, { 97, 71 } };
+
+// Radii checked, all from 0 up to this. Box and min filters are checked with windows of 2 * r + 1
+// pixels, and also with these even window sizes, a window size of 0 being treated as 1.
+constexpr coord_int maxRadius = 64;
+const coord_int evenWindowSizes[] = { 0, 2, 4, 16, 64 };
+
+// Length of the single rows and columns checked for rounding errors building up along them, and the
+// window sizes they are checked with. Running sums of float box filters are recomputed every
+// boxFilterResyncInterval() positions, at least 1024, so this many fall within the lines, most of
+// them part way through the chunk of rows or columns being filtered.
+constexpr coord_int longLineLength = 40000;
+const coord_int longLineWindowSizes[] = { 1, 129, 1001, 2049 };
+
+// Sizes of the synthetic hazy scenes and kernel sizes depth estimation is checked with. Scenes are
+// large enough next to the kernels for min-filtered depth to vary, as the error bounds need.
+const Coord depthSizes[] = { { 64, 1 }, { 97, 71 }, { 256, 192 } };
+const coord_int depthKernelSizes[] = { 1, 3, 7, 15 };
+
+// Sizes of the images filtered with different numbers of threads, wide and tall enough for the work
+// to split into several strips of columns and blocks of rows, and the thread counts compared.
+const Coord threadCheckSizes[] = { { 97, 71 }, { 1100, 300 } };
+const size_t threadCounts[] = { 1, 3 };
+
+// Random regions checked per image and window size.
+constexpr int regionsPerWindow = 4;
+
+// Regularisation of guided filters checked. Smaller values make the filter ill-conditioned on
+// random images, and float rounding errors then grow to swamp the comparison.
+constexpr float guidedFilterEps = 0.01f;
+
+// Tolerances, in units of pixel values, which are in [0, 1] for float images. Integer box filters
+// round to nearest after each pass, as the reference does, and min filters only compare, so those
+// are exact. Float box filters are within a few float epsilons of exact means, as their running sums
+// are recomputed periodically, so the bound holds for rows and columns of any length. Without
+// recomputing, longLineLength pixel lines exceed it, at about 1.2e-5. Guided filter errors are
+// those of float box filters amplified by inverting the 3x3 covariance matrices of the guide.
+// Fixed-point depth is compared in units of the bounds DepthPrecision documents, which it must be
+// within.
+constexpr double boxFilterTolerance = 1.0e-5;
+constexpr double guidedFilterTolerance = 1.0e-4;
+
+// Access to the channels of the pixel types checked, as doubles.
+template <typename PixelT>
+struct Channels {
+	using Element = PixelT;
+	static constexpr size_t count = 1;
+	static double get(const PixelT& p, size_t) { return double(p); }
+	static void set(PixelT& p, size_t, double v) { p = PixelT(v); }
+};
+
+template <>
+struct Channels<Pixel> {
+	using Element = float;
+	static constexpr size_t count = 3;
+	static double get(const Pixel& p, size_t c) { return double(p.values[c]); }
+	static void set(Pixel& p, size_t c, double v) { p.values[c] = float(v); }
+};
+
+template <>
+struct Channels<PixelRgb8> {
+	using Element = uint8_t;
+	static constexpr size_t count = 3;
+	static double get(const PixelRgb8& p, size_t c) { return double(p.values[c]); }
+	static void set(PixelRgb8& p, size_t c, double v) { p.values[c] = uint8_t(v); }
+};
+
+// Random value of an element: in [0, 1) if floating point, else in the whole range of the type.
+template <typename T>
+double randomValue(std::mt19937& rng, std::true_type /* floating point */) {
+	return std::uniform_real_distribution<double>{ 0.0, 1.0 }(rng);
+}
+
+template <typename T>
+double randomValue(std::mt19937& rng, std::false_type /* floating point */) {
+	return double(std::uniform_int_distribution<uint32_t>{ 0, std::numeric_limits<T>::max() }(rng));
+}
+
+template <typename PixelT>
+BaseImage<PixelT> randomImage(coord_int width, coord_int height, std::mt19937& rng) {
+	using Element = typename Channels<PixelT>::Element;
+
+	BaseImage<PixelT> image{ width, height };
+
+	for (auto& p : image.data()) {
+		for (size_t c = 0; c < Channels<PixelT>::count; ++c) {
+			Channels<PixelT>::set(p, c, randomValue<Element>(rng, std::is_floating_point<Element>{}));
+		}
+	}
+
+	return image;
+}
+
+// Plane of doubles, with one value per pixel of a single channel, row by row.
+struct Plane {
+	coord_int width, height;
+	std::vector<double> values;
+
+	double& at(coord_int x, coord_int y) { return values[size_t(y) * size_t(width) + size_t(x)]; }
+	double at(coord_int x, coord_int y) const { return values[size_t(y) * size_t(width) + size_t(x)]; }
+};
+
+template <typename PixelT>
+Plane channelOf(const BaseImage<PixelT>& image, size_t c) {
+	Plane plane{ image.width(), image.height(), {} };
+	plane.values.reserve(image.data().size());
+
+	for (const auto& p : image.data()) { plane.values.push_back(Channels<PixelT>::get(p, c)); }
+
+	return plane;
+}
+
+Plane product(const Plane& a, const Plane& b) {
+	Plane plane = a;
+	for (size_t i = 0; i < plane.values.size(); ++i) { plane.values[i] *= b.values[i]; }
+	return plane;
+}
+
+// Apply reduce(begin, end, i) to each line of plane along x if horizontal, else along y, reducing
+// elements [begin, end) of the line to a value for element i.
+template <typename Reduce>
+Plane referencePass(const Plane& plane, bool horizontal, Reduce reduce) {
+	Plane out{ plane.width, plane.height, {} };
+	out.values.resize(plane.values.size());
+
+	const auto n = horizontal ? plane.width : plane.height;
+	const auto numLines = horizontal ? plane.height : plane.width;
+
+	for (coord_int line = 0; line < numLines; ++line) {
+		auto element = [&](coord_int i) { return horizontal ? Coord{ i, line } : Coord{ line, i }; };
+
+		for (coord_int i = 0; i < n; ++i) {
+			const auto at = element(i);
+			out.at(at.x, at.y) = reduce([&](coord_int j) {
+				const auto other = element(j);
+				return plane.at(other.x, other.y);
+			}, n, i);
+		}
+	}
+
+	return out;
+}
+
+// Box filter with windows [i - (windowSize - 1) / 2, i + windowSize / 2] clipped to the image, as
+// boxFilter places them, summing in doubles. Means are rounded to nearest after each pass if round,
+// as integer box filters do.
+Plane referenceBoxFilter(const Plane& plane, coord_int windowSize, bool round) {
+	auto mean = [&](auto element, coord_int n, coord_int i) {
+		const auto begin = std::max(coord_int(0), i - (windowSize - 1) / 2);
+		const auto end = std::min(n, i + windowSize / 2 + 1);
+
+		double sum = 0.0;
+		for (auto j = begin; j < end; ++j) { sum += element(j); }
+
+		const auto value = sum / double(end - begin);
+		return round ? std::floor(value + 0.5) : value;
+	};
+
+	return referencePass(referencePass(plane, true, mean), false, mean);
+}
+
+// Min filter with windows of windowSize elements starting at max(0, i - windowSize / 2), elements
+// past the end of the image being clamped to the last one, as minFilter places them.
+Plane referenceMinFilter(const Plane& plane, coord_int windowSize) {
+	auto minimum = [&](auto element, coord_int n, coord_int i) {
+		const auto begin = std::max(coord_int(0), i - windowSize / 2);
+		const auto end = std::min(n, begin + windowSize);
+
+		double value = element(begin);
+		for (auto j = begin + 1; j < end; ++j) { value = std::min(value, element(j)); }
+
+		return value;
+	};
+
+	return referencePass(referencePass(plane, true, minimum), false, minimum);
+}
+
+// Guided filter of input with colour guide I, following He et al. directly: per-window linear
+// coefficients a = (Sigma + eps U)^-1 cov(I, p) and b = mean(p) - a . mean(I), with the 3x3
+// covariance matrix inverted by its adjugate, then q = mean(a) . I + mean(b). Means are those of
+// referenceBoxFilter, with windows of 2 * r + 1 pixels.
+Plane referenceGuidedFilter(const Plane& p, const Plane (&I)[3], coord_int r, double eps) {
+	auto mean = [&](const Plane& plane) { return referenceBoxFilter(plane, 2 * r + 1, false); };
+
+	const Plane meanI[3] = { mean(I[0]), mean(I[1]), mean(I[2]) };
+	const auto meanP = mean(p);
+	const Plane meanIp[3] = {
+		mean(product(I[0], p)), mean(product(I[1], p)), mean(product(I[2], p))
+	};
+
+	Plane meanII[3][3];
+	for (size_t i = 0; i < 3; ++i) {
+		for (size_t j = i; j < 3; ++j) { meanII[i][j] = meanII[j][i] = mean(product(I[i], I[j])); }
+	}
+
+	Plane a[3] = { p, p, p }, b = p;
+
+	for (size_t k = 0; k < p.values.size(); ++k) {
+		double sigma[3][3], cov[3];
+
+		for (size_t i = 0; i < 3; ++i) {
+			cov[i] = meanIp[i].values[k] - meanI[i].values[k] * meanP.values[k];
+
+			for (size_t j = 0; j < 3; ++j) {
+				sigma[i][j] = meanII[i][j].values[k] - meanI[i].values[k] * meanI[j].values[k];
+			}
+
+			sigma[i][i] += eps;
+		}
+
+		// Inverse of sigma, which is symmetric, as its adjugate over its determinant.
+		double inverse[3][3];
+		for (size_t i = 0; i < 3; ++i) {
+			for (size_t j = 0; j < 3; ++j) {
+				const auto i1 = (j + 1) % 3, i2 = (j + 2) % 3, j1 = (i + 1) % 3, j2 = (i + 2) % 3;
+				inverse[i][j] = sigma[i1][j1] * sigma[i2][j2] - sigma[i1][j2] * sigma[i2][j1];
+			}
+		}
+
+		const auto det = sigma[0][0] * inverse[0][0] + sigma[0][1] * inverse[1][0]
+			+ sigma[0][2] * inverse[2][0];
+
+		b.values[k] = meanP.values[k];
+
+		for (size_t i = 0; i < 3; ++i) {
+			const auto dot = inverse[i][0] * cov[0] + inverse[i][1] * cov[1] + inverse[i][2] * cov[2];
+			a[i].values[k] = dot / det;
+			b.values[k] -= a[i].values[k] * meanI[i].values[k];
+		}
+	}
+
+	const Plane meanA[3] = { mean(a[0]), mean(a[1]), mean(a[2]) };
+	const auto meanB = mean(b);
+
+	Plane q = meanB;
+	for (size_t k = 0; k < q.values.size(); ++k) {
+		for (size_t i = 0; i < 3; ++i) { q.values[k] += meanA[i].values[k] * I[i].values[k]; }
+	}
+
+	return q;
+}
+
+// Largest difference between channel c of image and reference within region, which image is the
+// size of.
+template <typename PixelT>
+double maxDifference(
+	const BaseImage<PixelT>& image, size_t c, const Plane& reference, const ImageView& region
+) {
+	double difference = 0.0;
+
+	for (coord_int y = 0; y < region.height(); ++y) {
+		for (coord_int x = 0; x < region.width(); ++x) {
+			const auto value = Channels<PixelT>::get(image.getPixelUnsafe(Coord{ x, y }), c);
+			const auto expected = reference.at(region.offset().x + x, region.offset().y + y);
+			difference = std::max(difference, std::fabs(value - expected));
+		}
+	}
+
+	return difference;
+}
+
+// Largest difference found by comparisons of one filter against its reference, and whether it is
+// within tolerance.
+class Check {
+public:
+	Check(std::string name, double tolerance) : m_name(std::move(name)), m_tolerance(tolerance) {}
+
+	void add(double difference) {
+		++m_numCases;
+		m_maxDifference = std::max(m_maxDifference, difference);
+	}
+
+	bool passed() const { return m_maxDifference <= m_tolerance; }
+
+	void report() const {
+		std::cout << std::left << std::setw(28) << m_name << std::right << std::setw(8) << m_numCases
+			<< std::scientific << std::setprecision(2) << std::setw(12) << m_maxDifference
+			<< std::setw(12) << m_tolerance << (passed() ? "    ok" : "    FAILED") << "\n";
+	}
+
+private:
+	std::string m_name;
+	double m_tolerance;
+	size_t m_numCases = 0;
+	double m_maxDifference = 0.0;
+};
+
+// Window sizes box and min filters are checked with.
+std::vector<coord_int> windowSizes() {
+	std::vector<coord_int> result;
+
+	for (coord_int r = 0; r <= maxRadius; ++r) { result.push_back(2 * r + 1); }
+	result.insert(result.end(), std::begin(evenWindowSizes), std::end(evenWindowSizes));
+
+	return result;
+}
+
+// Random region of image, possibly all of it.
+ImageView randomRegion(const ImageView& image, std::mt19937& rng) {
+	auto random = [&](coord_int min, coord_int max) {
+		return std::uniform_int_distribution<coord_int>{ min, max }(rng);
+	};
+
+	const auto x = random(0, image.width() - 1), y = random(0, image.height() - 1);
+	return ImageView{ Coord{ x, y }, random(1, image.width() - x), random(1, image.height() - y) };
+}
+
+// Check box filters of whole images and of regions of them against referenceBoxFilter.
+template <typename PixelT>
+void checkBoxFilter(Check& whole, Check& regions, std::mt19937& rng) {
+	const bool round = !std::is_floating_point<typename Channels<PixelT>::Element>::value;
+
+	for (const auto size : sizes) {
+		const auto image = randomImage<PixelT>(size.x, size.y, rng);
+
+		std::vector<Plane> channels;
+		for (size_t c = 0; c < Channels<PixelT>::count; ++c) {
+			channels.push_back(channelOf(image, c));
+		}
+
+		for (const auto windowSize : windowSizes()) {
+			const auto filtered = filters::boxFilter(image, size_t(windowSize));
+
+			std::vector<Plane> references;
+			for (const auto& channel : channels) {
+				references.push_back(referenceBoxFilter(channel, windowSize, round));
+			}
+
+			for (size_t c = 0; c < channels.size(); ++c) {
+				whole.add(maxDifference(filtered, c, references[c], image.getView()));
+			}
+
+			for (int i = 0; i < regionsPerWindow; ++i) {
+				const auto region = randomRegion(image.getView(), rng);
+				const auto filteredRegion = filters::boxFilter(image, region, size_t(windowSize));
+
+				for (size_t c = 0; c < channels.size(); ++c) {
+					regions.add(maxDifference(filteredRegion, c, references[c], region));
+				}
+			}
+		}
+	}
+}
+
+// Check float box filters of a single row and a single column longLineLength pixels long against
+// referenceBoxFilter.
+template <typename PixelT>
+void checkLongLines(Check& check, std::mt19937& rng) {
+	for (const auto size : { Coord{ longLineLength, 1 }, Coord{ 1, longLineLength } }) {
+		const auto image = randomImage<PixelT>(size.x, size.y, rng);
+
+		for (const auto windowSize : longLineWindowSizes) {
+			const auto filtered = filters::boxFilter(image, size_t(windowSize));
+
+			for (size_t c = 0; c < Channels<PixelT>::count; ++c) {
+				const auto reference = referenceBoxFilter(channelOf(image, c), windowSize, false);
+				check.add(maxDifference(filtered, c, reference, image.getView()));
+			}
+		}
+	}
+}
+
+// Same for min filters against referenceMinFilter.
+template <typename PixelT>
+void checkMinFilter(Check& whole, Check& regions, std::mt19937& rng) {
+	for (const auto size : sizes) {
+		const auto image = randomImage<PixelT>(size.x, size.y, rng);
+
+		for (const auto windowSize : windowSizes()) {
+			const auto reference = referenceMinFilter(channelOf(image, 0), windowSize);
+
+			whole.add(maxDifference(
+				filters::minFilter(image, size_t(windowSize)), 0, reference, image.getView()
+			));
+
+			for (int i = 0; i < regionsPerWindow; ++i) {
+				const auto region = randomRegion(image.getView(), rng);
+				regions.add(maxDifference(
+					filters::minFilter(image, region, size_t(windowSize)), 0, reference, region
+				));
+			}
+		}
+	}
+}
+
+// Check boxFilterMany, of an image and of a product of images, against boxFilter, which it should
+// match exactly.
+void checkBoxFilterMany(Check& check, std::mt19937& rng) {
+	for (const auto size : sizes) {
+		const auto a = randomImage<float>(size.x, size.y, rng);
+		const auto b = randomImage<float>(size.x, size.y, rng);
+		const auto ab = a * b;
+
+		for (const auto windowSize : windowSizes()) {
+			const auto many = filters::boxFilterMany(
+				size.x, size.y, { filters::rowsOf(a), filters::rowsOfProduct(a, b) }, size_t(windowSize)
+			);
+
+			const auto expectedA = channelOf(filters::boxFilter(a, size_t(windowSize)), 0);
+			const auto expectedAb = channelOf(filters::boxFilter(ab, size_t(windowSize)), 0);
+
+			check.add(maxDifference(many[0], 0, expectedA, a.getView()));
+			check.add(maxDifference(many[1], 0, expectedAb, a.getView()));
+		}
+	}
+}
+
+// Check means of a summed-area table with random radii against referenceBoxFilter. Some radii are
+// negative, which should be taken as 0.
+void checkSummedAreaTable(Check& check, std::mt19937& rng) {
+	for (const auto size : sizes) {
+		const auto image = randomImage<float>(size.x, size.y, rng);
+		const auto plane = channelOf(image, 0);
+
+		BaseImage<coord_int> radii{ size.x, size.y };
+		std::uniform_int_distribution<coord_int> radius{ -2, maxRadius };
+		for (auto& r : radii.data()) { r = radius(rng); }
+
+		std::vector<Plane> references;
+		for (coord_int r = 0; r <= maxRadius; ++r) {
+			references.push_back(referenceBoxFilter(plane, 2 * r + 1, false));
+		}
+
+		const auto means = filters::SummedAreaTable{ image }.means(radii);
+		double difference = 0.0;
+
+		for (const auto c : image.getView()) {
+			const auto& reference = references[size_t(std::max(radii.getPixelUnsafe(c), coord_int(0)))];
+			const auto mean = double(means.getPixelUnsafe(c));
+			difference = std::max(difference, std::fabs(mean - reference.at(c.x, c.y)));
+		}
+
+		check.add(difference);
+	}
+}
+
+// Check depth estimated with fixed-point precisions against DepthPrecision::Float, on synthetic hazy
+// scenes with random seeds, in units of the error bound documented for each precision. The bound
+// depends on R, the range of min-filtered depth, which is found from referenceMinFilter of depth
+// estimated as Pixel does.
+void checkDepthPrecision(Check& uint16, Check& uint8, std::mt19937& rng) {
+	using filters::DepthPrecision;
+
+	for (const auto size : depthSizes) {
+		const auto image = generateHazyScene(size.x, size.y, uint32_t(rng())).hazy;
+
+		Plane depth{ size.x, size.y, {} };
+		for (const auto& p : image.data()) {
+			const auto value = 0.121779f + p.getLuminance() * 0.959710f
+				- p.getSaturation() * 0.780245f;
+			depth.values.push_back(double(clamp(value, 0.0f, 1.0f)));
+		}
+
+		for (const auto kernelSize : depthKernelSizes) {
+			const auto filtered = referenceMinFilter(depth, kernelSize);
+			const auto range = std::minmax_element(filtered.values.begin(), filtered.values.end());
+			const auto R = *range.second - *range.first;
+
+			const auto reference = channelOf(
+				filters::getDepthFromHazyImage(image, size_t(kernelSize), DepthPrecision::Float), 0
+			);
+
+			auto compare = [&](Check& check, DepthPrecision precision, double scale) {
+				const auto estimated = filters::getDepthFromHazyImage(
+					image, size_t(kernelSize), precision
+				);
+				assert(scale * R > 1.0);
+				const auto bound = 2.0 / (scale * R - 1.0);
+
+				check.add(maxDifference(estimated, 0, reference, image.getView()) / bound);
+			};
+
+			compare(uint16, DepthPrecision::Uint16, 65535.0);
+			compare(uint8, DepthPrecision::Uint8, 255.0);
+		}
+	}
+}
+
+// Difference between images that must be identical bit for bit: 0 if they are, else the largest
+// difference between their values, or infinity if only their bits differ, e.g. for 0 and -0.
+template <typename PixelT>
+double bitwiseDifference(const BaseImage<PixelT>& a, const BaseImage<PixelT>& b) {
+	if (a.width() != b.width() || a.height() != b.height()) {
+		return std::numeric_limits<double>::infinity();
+	}
+
+	if (std::memcmp(a.data().data(), b.data().data(), a.data().size() * sizeof(PixelT)) == 0) {
+		return 0.0;
+	}
+
+	double difference = 0.0;
+
+	for (size_t c = 0; c < Channels<PixelT>::count; ++c) {
+		difference = std::max(difference, maxDifference(a, c, channelOf(b, c), a.getView()));
+	}
+
+	return difference > 0.0 ? difference : std::numeric_limits<double>::infinity();
+}
+
+// Check that filters give the same results bit for bit whatever the number of threads, running
+// each with every count in threadCounts on synthetic hazy scenes. The shared thread pool is put
+// back to its previous number of threads afterwards.
+void checkThreadCounts(Check& check, std::mt19937& rng) {
+	const auto previousThreadCount = getThreadCount();
+
+	for (const auto size : threadCheckSizes) {
+		const auto scene = generateHazyScene(size.x, size.y, uint32_t(rng()));
+		const auto& hazy = scene.hazy;
+		const auto& depth = scene.depth;
+		const auto hazy8 = randomImage<PixelRgb8>(size.x, size.y, rng);
+
+		auto compare = [&](auto filter) {
+			setThreadCount(threadCounts[0]);
+			const auto expected = filter();
+
+			for (size_t i = 1; i < std::extent<decltype(threadCounts)>::value; ++i) {
+				setThreadCount(threadCounts[i]);
+				check.add(bitwiseDifference(expected, filter()));
+			}
+		};
+
+		for (const auto windowSize : { size_t(1), size_t(9), size_t(129) }) {
+			compare([&] { return filters::boxFilter(depth, windowSize); });
+			compare([&] { return filters::boxFilter(hazy, windowSize); });
+			compare([&] { return filters::boxFilter(hazy8, windowSize); });
+			compare([&] { return filters::minFilter(depth, windowSize); });
+			compare([&] {
+				return filters::boxFilterMany(size.x, size.y,
+					{ filters::rowsOf(depth), filters::rowsOfProduct(depth, depth) }, windowSize
+				)[1];
+			});
+		}
+
+		using filters::DepthPrecision;
+
+		for (const auto precision : { DepthPrecision::Float, DepthPrecision::Uint8 }) {
+			compare([&] { return filters::getDepthFromHazyImage(hazy, 7, precision); });
+		}
+
+		const auto eps = guidedFilterEps;
+
+		for (const auto subsample : { size_t(1), size_t(4) }) {
+			compare([&] { return filters::guidedFilter(depth, hazy, 9, eps, subsample); });
+			compare([&] { return filters::guidedFilter(hazy, hazy, 9, eps, subsample); });
+		}
+	}
+
+	setThreadCount(previousThreadCount);
+}
+
+// Check GuidedFilterCache: lookups with the same guide contents and parameters hit and share
+// values, lookups with other parameters miss, the least recently used values are dropped once the
+// cache is over capacity, and filtering with cached values equals guidedFilter bit for bit, also
+// into outputs and buffers reused from one call to the next, and in place.
+// Expectations met add a difference of 0, those not met infinity.
+void checkGuidedFilterCache(Check& check, std::mt19937& rng) {
+	auto expect = [&](bool met) { check.add(met ? 0.0 : std::numeric_limits<double>::infinity()); };
+
+	const auto scene = generateHazyScene(97, 71, uint32_t(rng()));
+	const auto& guide = scene.hazy;
+	const auto copy = guide;
+	const auto eps = guidedFilterEps;
+
+	{
+		filters::GuidedFilterCache cache{ 4 };
+
+		const auto values = cache.get(guide, 9, eps);
+		expect(cache.misses() == 1 && cache.hits() == 0);
+
+		// The same contents in another image hit
+		expect(cache.get(copy, 9, eps) == values && cache.hits() == 1);
+
+		for (const auto& other : {
+			cache.get(guide, 9, 2.0f * eps), cache.get(guide, 5, eps), cache.get(guide, 9, eps, 4)
+		}) {
+			expect(other != values);
+		}
+
+		expect(cache.misses() == 4 && cache.hits() == 1 && cache.size() == 4);
+	}
+
+	{
+		// Capacity for 2, filled with a and b, then a used again, so that c drops b.
+		filters::GuidedFilterCache cache{ 2 };
+
+		const auto a = cache.get(guide, 1, eps);
+		const auto b = cache.get(guide, 2, eps);
+		expect(cache.get(guide, 1, eps) == a);
+
+		cache.get(guide, 3, eps);
+		expect(cache.size() == 2);
+		expect(cache.get(guide, 1, eps) == a);
+		expect(cache.get(guide, 2, eps) != b && cache.misses() == 4);
+	}
+
+	{
+		filters::GuidedFilterCache cache{ 2 };
+		filters::GuidedFilterBuffers buffers;
+		ImageGrey grey{ 0, 0 };
+		ImageRgb colour{ 0, 0 };
+
+		for (const auto subsample : { size_t(1), size_t(4) }) {
+			const auto& values = *cache.get(guide, 9, eps, subsample);
+			const auto expectedGrey = filters::guidedFilter(scene.depth, guide, 9, eps, subsample);
+			const auto expectedColour = filters::guidedFilter(scene.clear, guide, 9, eps, subsample);
+
+			check.add(bitwiseDifference(values.filter(scene.depth, guide), expectedGrey));
+			check.add(bitwiseDifference(values.filter(scene.clear, guide), expectedColour));
+
+			values.filter(scene.depth, guide, grey, buffers);
+			values.filter(scene.clear, guide, colour, buffers);
+			check.add(bitwiseDifference(grey, expectedGrey));
+			check.add(bitwiseDifference(colour, expectedColour));
+
+			auto inPlace = scene.clear;
+			values.filter(inPlace, guide, inPlace, buffers);
+			check.add(bitwiseDifference(inPlace, expectedColour));
+		}
+	}
+}
+
+// Filter input with guidedFilterRows into an image.
+ImageGrey guidedFilterStreamed(const ImageGrey& input, const ImageRgb& guide, size_t r, float eps) {
+	ImageGrey out{ input.width(), input.height() };
+
+	filters::guidedFilterRows(input.width(), input.height(), filters::rowsOf(input),
+		filters::rowsOf(guide), r, eps, [&](coord_int y, const float* row) {
+			std::copy(row, row + input.width(), &out.getPixelUnsafe(Coord{ 0, y }));
+		}
+	);
+
+	return out;
+}
+
+// Check greyscale, colour and streaming guided filters, with random guides, against
+// referenceGuidedFilter.
+void checkGuidedFilter(Check& grey, Check& colour, Check& streamed, std::mt19937& rng) {
+	for (const auto size : sizes) {
+		const auto guide = randomImage<Pixel>(size.x, size.y, rng);
+		const auto input = randomImage<Pixel>(size.x, size.y, rng);
+		const auto inputGrey = randomImage<float>(size.x, size.y, rng);
+
+		const Plane I[3] = { channelOf(guide, 0), channelOf(guide, 1), channelOf(guide, 2) };
+
+		for (coord_int r = 0; r <= maxRadius; ++r) {
+			const auto eps = guidedFilterEps;
+
+			const auto referenceGrey = referenceGuidedFilter(channelOf(inputGrey, 0), I, r, eps);
+
+			grey.add(maxDifference(
+				filters::guidedFilter(inputGrey, guide, size_t(r), eps), 0, referenceGrey,
+				guide.getView()
+			));
+
+			streamed.add(maxDifference(
+				guidedFilterStreamed(inputGrey, guide, size_t(r), eps), 0, referenceGrey,
+				guide.getView()
+			));
+
+			const auto filtered = filters::guidedFilter(input, guide, size_t(r), eps);
+
+			for (size_t c = 0; c < 3; ++c) {
+				const auto reference = referenceGuidedFilter(channelOf(input, c), I, r, eps);
+				colour.add(maxDifference(filtered, c, reference, guide.getView()));
+			}
+		}
+	}
+}
+
+// Median run-time of fn in milliseconds over repetitions runs, after one warm-up run.
+template <typename Fn>
+double medianMilliseconds(size_t repetitions, Fn fn) {
+	std::vector<double> times;
+
+	for (size_t i = 0; i < repetitions + 1; ++i) {
+		const auto start = std::chrono::steady_clock::now();
+		fn();
+		const auto end = std::chrono::steady_clock::now();
+
+		if (i > 0) { times.push_back(std::chrono::duration<double, std::milli>(end - start).count()); }
+	}
+
+	std::sort(times.begin(), times.end());
+	return times[times.size() / 2];
+}
+
+// Throughput of each filter on random width x height images.
+void reportThroughput(
+	coord_int width, coord_int height, size_t r, size_t repetitions, std::mt19937& rng
+) {
+	const auto grey = randomImage<float>(width, height, rng);
+	const auto rgb = randomImage<Pixel>(width, height, rng);
+	const auto grey8 = randomImage<uint8_t>(width, height, rng);
+	const auto rgb8 = randomImage<PixelRgb8>(width, height, rng);
+	const auto windowSize = 2 * r + 1;
+
+	BaseImage<coord_int> radii{ width, height };
+	std::fill(radii.data().begin(), radii.data().end(), coord_int(r));
+
+	const double megapixels = double(width) * double(height) / 1.0e6;
+
+	std::cout << "\nThroughput on " << width << 'x' << height << " images, radius " << r << ", "
+		<< getThreadCount() << " threads\n"
+		<< std::left << std::setw(28) << "filter" << std::right << std::setw(12) << "median ms"
+		<< std::setw(12) << "MPix/s" << "\n";
+
+	auto time = [&](const std::string& name, auto fn) {
+		const auto milliseconds = medianMilliseconds(repetitions, fn);
+
+		std::cout << std::left << std::setw(28) << name << std::right << std::fixed
+			<< std::setprecision(2) << std::setw(12) << milliseconds
+			<< std::setw(12) << megapixels / (milliseconds / 1000.0) << "\n";
+	};
+
+	auto timeBoxFilter = [&](const std::string& name, const auto& image) {
+		using PixelT = typename std::decay_t<decltype(image)>::PixelType;
+
+		BaseImage<PixelT> out{ 0, 0 };
+		filters::BoxFilterBuffers<PixelT> buffers;
+
+		time(name, [&] { filters::boxFilter(image, windowSize, out, buffers); });
+	};
+
+	timeBoxFilter("boxFilter float", grey);
+	timeBoxFilter("boxFilter Pixel", rgb);
+	timeBoxFilter("boxFilter uint8_t", grey8);
+	timeBoxFilter("boxFilter PixelRgb8", rgb8);
+	time("minFilter float", [&] { filters::minFilter(grey, windowSize); });
+	time("minFilter uint8_t", [&] { filters::minFilter(grey8, windowSize); });
+	time("SummedAreaTable::means", [&] { filters::SummedAreaTable{ grey }.means(radii); });
+	time("guidedFilter grey", [&] { filters::guidedFilter(grey, rgb, r, guidedFilterEps); });
+	time("guidedFilter rgb", [&] { filters::guidedFilter(rgb, rgb, r, guidedFilterEps); });
+	time("guidedFilterRows", [&] { guidedFilterStreamed(grey, rgb, r, guidedFilterEps); });
+
+	// Guide statistics computed once, as when filtering several images with the same guide
+	const filters::GuidedFilterValues values{ rgb, r, guidedFilterEps };
+	ImageGrey filtered{ 0, 0 };
+	filters::GuidedFilterBuffers buffers;
+
+	time("GuidedFilterValues::filter", [&] { values.filter(grey, rgb, filtered, buffers); });
+}
+
+} // namespace
+
+bool verifyFilters(uint32_t seed, coord_int width, coord_int height, size_t r, size_t repetitions) {
+	std::mt19937 rng{ seed };
+
+	Check boxFloat{ "boxFilter float", boxFilterTolerance };
+	Check boxFloatRegion{ "boxFilter float region", boxFilterTolerance };
+	Check boxRgb{ "boxFilter Pixel", boxFilterTolerance };
+	Check boxRgbRegion{ "boxFilter Pixel region", boxFilterTolerance };
+	Check boxFloatLong{ "boxFilter float long lines", boxFilterTolerance };
+	Check boxRgbLong{ "boxFilter Pixel long lines", boxFilterTolerance };
+	Check box8{ "boxFilter uint8_t", 0.0 };
+	Check box8Region{ "boxFilter uint8_t region", 0.0 };
+	Check box16{ "boxFilter uint16_t", 0.0 };
+	Check box16Region{ "boxFilter uint16_t region", 0.0 };
+	Check boxRgb8{ "boxFilter PixelRgb8", 0.0 };
+	Check boxRgb8Region{ "boxFilter PixelRgb8 region", 0.0 };
+	Check boxMany{ "boxFilterMany", 0.0 };
+	Check minFloat{ "minFilter float", 0.0 };
+	Check minFloatRegion{ "minFilter float region", 0.0 };
+	Check min8{ "minFilter uint8_t", 0.0 };
+	Check min8Region{ "minFilter uint8_t region", 0.0 };
+	Check sat{ "SummedAreaTable::means", boxFilterTolerance };
+	Check guidedGrey{ "guidedFilter grey", guidedFilterTolerance };
+	Check guidedRgb{ "guidedFilter rgb", guidedFilterTolerance };
+	Check guidedRows{ "guidedFilterRows", guidedFilterTolerance };
+	Check depth16{ "depth Uint16 / bound", 1.0 };
+	Check depth8{ "depth Uint8 / bound", 1.0 };
+	Check threads{ "threads 1 and 3 identical", 0.0 };
+	Check cache{ "GuidedFilterCache", 0.0 };
+
+	checkBoxFilter<float>(boxFloat, boxFloatRegion, rng);
+	checkBoxFilter<Pixel>(boxRgb, boxRgbRegion, rng);
+	checkLongLines<float>(boxFloatLong, rng);
+	checkLongLines<Pixel>(boxRgbLong, rng);
+	checkBoxFilter<uint8_t>(box8, box8Region, rng);
+	checkBoxFilter<uint16_t>(box16, box16Region, rng);
+	checkBoxFilter<PixelRgb8>(boxRgb8, boxRgb8Region, rng);
+	checkBoxFilterMany(boxMany, rng);
+	checkMinFilter<float>(minFloat, minFloatRegion, rng);
+	checkMinFilter<uint8_t>(min8, min8Region, rng);
+	checkSummedAreaTable(sat, rng);
+	checkGuidedFilter(guidedGrey, guidedRgb, guidedRows, rng);
+	checkDepthPrecision(depth16, depth8, rng);
+	checkThreadCounts(threads, rng);
+	checkGuidedFilterCache(cache, rng);
+
+	const Check* checks[] = {
+		&boxFloat, &boxFloatRegion, &boxRgb, &boxRgbRegion, &boxFloatLong, &boxRgbLong, &box8,
+		&box8Region, &box16, &box16Region, &boxRgb8, &boxRgb8Region, &boxMany, &minFloat,
+		&minFloatRegion, &min8, &min8Region, &sat, &guidedGrey, &guidedRgb, &guidedRows, &depth16,
+		&depth8, &threads, &cache
+	};
+
+	std::cout << std::left << std::setw(28) << "filter" << std::right << std::setw(8) << "cases"
+		<< std::setw(12) << "max diff" << std::setw(12) << "tolerance" << "\n";
+
+	bool passed = true;
+
+	for (const auto* check : checks) {
+		check->report();
+		passed = passed && check->passed();
+	}
+
+	reportThroughput(width, height, r, repetitions, rng);
+
+	std::cout << "\n" << (passed ? "All filters match their references." : "Some filters FAILED.")
+		<< std::endl;
+
+	return passed;
+}
+
+} // namespace ImgProc
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "util.h"
+
+namespace ImgProc {
+
+/** Check the optimised filters (box filter, box filter over regions, boxFilterMany, min filter,
+ * summed-area table, and whole-image and streaming guided filters) against naive reference
+ * implementations, on random images of sizes including single rows and columns and images smaller
+ * than the window, for all radii from 0 to 64, and float box filters on rows and columns 40000
+ * pixels long. Also checks depth estimated with fixed-point precisions against float precision, on
+ * synthetic hazy scenes, within the bounds documented in DepthPrecision, that filters give the same
+ * results bit for bit with 1 and 3 threads, and the lookups and eviction of GuidedFilterCache.
+ * Prints the largest difference found for each check next to its tolerance, then the throughput of
+ * each filter in MPix/s on a random width x height image, as the median of the given number of
+ * repetitions with radius r. Returns whether all checks are within tolerance. Leaves the shared
+ * thread pool with the number of threads it had.
+ */
+bool verifyFilters(uint32_t seed, coord_int width, coord_int height, size_t r, size_t repetitions);
+
+} // namespace ImgProc